@@ -0,0 +1,104 @@
+// Runs the Wheelwriter bus on the RP2040's second core
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+#include "BusCore.h"
+
+using namespace wheelwriter;
+
+void BusCore::init(Uart9Bit* uart, const uint8_t* commandLengths, const uint16_t* commandTimeouts,
+                   uint8_t maxValidCommand, uint8_t statusCommand) {
+	uart_ = uart;
+	engine_.init(uart, commandLengths, commandTimeouts, maxValidCommand, statusCommand);
+}
+void BusCore::setReadiness(ReadinessModel* readiness) {
+	engine_.setReadiness(readiness);
+}
+void BusCore::setInline(bool runInline) {
+	inline_ = runInline;
+}
+bool BusCore::runInline() {
+	return inline_;
+}
+
+void BusCore::run() {
+	uint8_t cancel = cancelRequest_.load(std::memory_order_acquire);
+	if (cancel != cancelDone_.load(std::memory_order_relaxed)) {
+		// Everything posted before the request is taken in first
+		_takeRequests();
+		engine_.cancelPending();
+		cancelDone_.store(cancel, std::memory_order_release);
+	}
+	if (pauseRequest_.load(std::memory_order_acquire)) {
+		if (engine_.idle() && requests_.empty()) {
+			paused_.store(true, std::memory_order_release);
+			return;
+		}
+	}
+	else if (paused_.load(std::memory_order_relaxed)) {
+		paused_.store(false, std::memory_order_release);
+	}
+
+	_takeRequests();
+	engine_.service();
+
+	// Anything else is for the frame decoder. Replies are the engine's while it has work.
+	if (engine_.idle() && requests_.empty()) {
+		while (uart_->available()) {
+			BusWord word;
+			word.word = uart_->read(word.timestamp);
+			if (!words_.push(word)) {
+				droppedWords_.store(droppedWords_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			}
+		}
+	}
+}
+void BusCore::_takeRequests() {
+	BusTransaction request;
+	while (!engine_.full() && requests_.pop(request)) {
+		engine_.submit(request.address, request.command, request.data1, request.data2, request.flags,
+		               _finished, this, request.timeout);
+	}
+}
+void BusCore::_finished(const BusTransaction& transaction, void* context) {
+	((BusCore*)context)->results_.push(transaction);
+}
+
+bool BusCore::post(const BusTransaction& transaction) {
+	return requests_.push(transaction);
+}
+bool BusCore::takeResult(BusTransaction& transaction) {
+	return results_.pop(transaction);
+}
+bool BusCore::takeWord(uint16_t& word, uint32_t& timestamp) {
+	BusWord busWord;
+	if (!words_.pop(busWord)) {
+		return false;
+	}
+	word = busWord.word;
+	timestamp = busWord.timestamp;
+	return true;
+}
+void BusCore::cancelPending() {
+	uint8_t cancel = cancelRequest_.load(std::memory_order_relaxed) + 1;
+	cancelRequest_.store(cancel, std::memory_order_release);
+	while (cancelDone_.load(std::memory_order_acquire) != cancel) {
+		if (inline_) {
+			run();
+		}
+	}
+}
+void BusCore::pause() {
+	pauseRequest_.store(true, std::memory_order_release);
+	while (!paused_.load(std::memory_order_acquire)) {
+		if (inline_) {
+			run();
+		}
+	}
+}
+void BusCore::resume() {
+	pauseRequest_.store(false, std::memory_order_release);
+}
+uint32_t BusCore::droppedWords() {
+	return droppedWords_.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,90 @@
+// Runs the Wheelwriter bus on the RP2040's second core
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+// The second core owns the UART and a BusTransactionEngine of its own, and
+// does nothing but call run(). The first core's engine (see
+// BusTransactionEngine::setBusCore()) hands each transaction over as it is
+// submitted, and gets the result back when it finishes, so the mechanism is
+// kept busy however long the first core spends on the network or USB, and the
+// first core isn't held up while the bus is busy.
+//
+// Everything between the cores goes through lock-free single-producer/
+// single-consumer queues: transactions one way, and their results and the
+// words seen while the bus is idle (keyboard traffic, for the frame decoder)
+// the other. Cancelling and pausing are requested with a flag the second core
+// answers on its next pass.
+//
+// Without a second core (the simulator), setInline(true) has run() called by
+// the first core whenever it services its engine.
+//
+#pragma once
+
+#include <atomic>
+#include "BusTransactionEngine.h"
+#include "SpscQueue.h"
+
+namespace wheelwriter {
+
+class BusCore {
+public:
+	// Words seen while the bus is idle, waiting to be decoded
+	static const uint16_t WORD_QUEUE_SIZE = 64;
+
+	BusCore() : uart_(NULL), inline_(false), cancelRequest_(0), cancelDone_(0), pauseRequest_(false),
+	            paused_(false), droppedWords_(0) {}
+	// Called on the first core, before the second is started. Arguments as for BusTransactionEngine::init().
+	void init(Uart9Bit* uart, const uint8_t* commandLengths, const uint16_t* commandTimeouts,
+	          uint8_t maxValidCommand, uint8_t statusCommand);
+	// The model is only touched by the second core while transactions are outstanding
+	void setReadiness(ReadinessModel* readiness);
+	void setInline(bool runInline);
+	bool runInline();
+
+	// Second core. Takes new transactions, steps the engine and passes on the
+	// results and, while idle, what comes in. Never blocks.
+	void run();
+
+	// First core. Queues a transaction to be run. Returns false if the queue is full.
+	bool post(const BusTransaction& transaction);
+	// First core. Takes the next finished transaction, in the order they were posted.
+	bool takeResult(BusTransaction& transaction);
+	// First core. Takes the next word seen on the bus while it was idle.
+	bool takeWord(uint16_t& word, uint32_t& timestamp);
+	// First core. Cancels the transactions that haven't started yet, as
+	// BusTransactionEngine::cancelPending(). Their results are queued as cancelled.
+	void cancelPending();
+	// First core. Waits for the bus to go idle, then parks the second core and
+	// leaves the UART to the caller until resume().
+	void pause();
+	void resume();
+	// Words dropped because the first core wasn't taking them
+	uint32_t droppedWords();
+
+private:
+	struct BusWord {
+		uint16_t word;
+		uint32_t timestamp;
+	};
+	void _takeRequests();
+	static void _finished(const BusTransaction& transaction, void* context);
+
+	// Second core only
+	BusTransactionEngine engine_;
+	Uart9Bit* uart_;
+	bool inline_;
+
+	SpscQueue<BusTransaction, BusTransactionEngine::QUEUE_SIZE> requests_;  // First core to second
+	// No more than QUEUE_SIZE transactions are ever outstanding, so these can't overflow
+	SpscQueue<BusTransaction, BusTransactionEngine::QUEUE_SIZE> results_;   // Second core to first
+	SpscQueue<BusWord, WORD_QUEUE_SIZE> words_;                             // Second core to first
+
+	// Requests from the first core, answered by the second
+	std::atomic<uint8_t> cancelRequest_;
+	std::atomic<uint8_t> cancelDone_;
+	std::atomic<bool> pauseRequest_;
+	std::atomic<bool> paused_;
+	std::atomic<uint32_t> droppedWords_;
+};
+
+} // namespace wheelwriter
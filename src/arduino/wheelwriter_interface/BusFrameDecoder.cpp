@@ -0,0 +1,105 @@
+// Resumable decoder for command frames seen on the Wheelwriter bus
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+#include "BusFrameDecoder.h"
+#include "Wheelwriter.h"
+
+using namespace wheelwriter;
+
+void BusFrameDecoder::init(const uint8_t* commandLengths, uint8_t maxValidCommand) {
+	commandLengths_ = commandLengths;
+	maxValidCommand_ = maxValidCommand;
+	clear();
+}
+void BusFrameDecoder::receive(uint16_t word, uint32_t timestamp) {
+	if (word & WW_ADDRESS_BIT) {
+		if (inFrame_) {
+			// The last frame was cut off
+			resyncs_++;
+		}
+		frame_ = BusFrame();
+		frame_.address = word & 0xff;
+		frame_.timestamp = timestamp;
+		inFrame_ = true;
+		part_ = 0;
+		awaitingAck_ = true;
+		return;
+	}
+	if (!inFrame_) {
+		// Nothing to go with - wait for the next address
+		resyncs_++;
+		return;
+	}
+
+	if (awaitingAck_) {
+		frame_.acks[part_] = word;
+		frame_.duration = timestamp - frame_.timestamp;
+		awaitingAck_ = false;
+		if ((part_ > 0) && (part_ >= frame_.length)) {
+			// The reply to the last part can carry a value
+			if (count_ == RING_SIZE) {
+				head_ = (head_ + 1) % RING_SIZE;
+				count_--;
+				overruns_++;
+			}
+			ring_[(head_ + count_) % RING_SIZE] = frame_;
+			count_++;
+			inFrame_ = false;
+		}
+		else if (word != 0) {
+			resync();
+		}
+		return;
+	}
+
+	part_++;
+	switch (part_) {
+		case 1:
+			frame_.command = word & 0xff;
+			if ((frame_.command > maxValidCommand_) || !commandLengths_ || !commandLengths_[frame_.command]) {
+				resync();
+				return;
+			}
+			frame_.length = commandLengths_[frame_.command];
+			break;
+		case 2:
+			frame_.data1 = word & 0xff;
+			break;
+		case 3:
+			frame_.data2 = word & 0xff;
+			break;
+	}
+	awaitingAck_ = true;
+}
+bool BusFrameDecoder::read(BusFrame& frame) {
+	if (!count_) {
+		return false;
+	}
+	frame = ring_[head_];
+	head_ = (head_ + 1) % RING_SIZE;
+	count_--;
+	return true;
+}
+bool BusFrameDecoder::available() {
+	return count_ > 0;
+}
+void BusFrameDecoder::clear() {
+	inFrame_ = false;
+	part_ = 0;
+	awaitingAck_ = false;
+	head_ = 0;
+	count_ = 0;
+	overruns_ = 0;
+	resyncs_ = 0;
+}
+uint32_t BusFrameDecoder::overruns() {
+	return overruns_;
+}
+uint32_t BusFrameDecoder::resyncs() {
+	return resyncs_;
+}
+void BusFrameDecoder::resync() {
+	inFrame_ = false;
+	resyncs_++;
+}
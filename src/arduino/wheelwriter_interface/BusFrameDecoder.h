@@ -0,0 +1,75 @@
+// Resumable decoder for command frames seen on the Wheelwriter bus
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+// Words are fed in one at a time as they come off the bus, so a frame can be
+// split across any number of calls and nothing ever waits for the rest of it.
+// A frame is the address, the command and its data, each answered by the
+// device addressed. Complete frames are queued in a ring until they are read;
+// if the reader falls behind, the oldest are dropped.
+//
+// A word with the address bit (the 9th bit) always starts a new frame, so the
+// decoder picks up again at the next address after anything garbled or cut
+// off. Words outside a frame, frames with an unknown command and frames
+// answered with anything but an ACK before their last part are dropped.
+//
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace wheelwriter {
+
+struct BusFrame {
+	uint8_t address;
+	uint8_t command;
+	uint8_t data1;
+	uint8_t data2;
+	uint8_t length;      // Parts sent, including the command (see ww_command_length)
+	uint16_t acks[4];    // Replies to the address, command, data1 and data2
+	uint32_t timestamp;  // Receive time of the address, in microseconds
+	uint32_t duration;   // Microseconds from the address to the last reply
+};
+
+class BusFrameDecoder {
+public:
+	static const uint8_t RING_SIZE = 16;
+
+	BusFrameDecoder() : commandLengths_(NULL), maxValidCommand_(0) {
+		clear();
+	}
+	// commandLengths is indexed by command
+	void init(const uint8_t* commandLengths, uint8_t maxValidCommand);
+	// Takes the next word seen on the bus and the time it was received
+	void receive(uint16_t word, uint32_t timestamp);
+	// Takes the oldest complete frame. Returns false if there isn't one.
+	bool read(BusFrame& frame);
+	bool available();
+	// Drops the frame in progress and any waiting to be read
+	void clear();
+	// Complete frames dropped because the ring was full
+	uint32_t overruns();
+	// Times words were dropped to get back in step
+	uint32_t resyncs();
+
+private:
+	// Drops the frame in progress, until the next address
+	void resync();
+
+	const uint8_t* commandLengths_;
+	uint8_t maxValidCommand_;
+
+	// Frame in progress
+	BusFrame frame_;
+	bool inFrame_;
+	uint8_t part_;        // Part last received (0: address .. 3: data2)
+	bool awaitingAck_;
+
+	BusFrame ring_[RING_SIZE];
+	uint8_t head_;        // Oldest complete frame
+	uint8_t count_;
+	uint32_t overruns_;
+	uint32_t resyncs_;
+};
+
+} // namespace wheelwriter
@@ -0,0 +1,368 @@
+// Non-blocking bus transaction engine for the Wheelwriter
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+#include "BusTransactionEngine.h"
+#include "BusCore.h"
+#include "ReadinessModel.h"
+#include "Wheelwriter.h"
+#include <Arduino.h>
+
+using namespace wheelwriter;
+
+// Times are taken from the hardware timer, not micros()/millis(). On the second
+// core (see BusCore) those would go through the mbed ticker, which is shared
+// with the first core and only guarded against interrupts on the calling core.
+
+// Never a valid reply, so it is treated as a bad ACK
+static const uint16_t FRAMING_ERROR = 0xffff;
+
+void BusTransactionEngine::init(Uart9Bit* uart, const uint8_t* commandLengths, const uint16_t* commandTimeouts,
+                                uint8_t maxValidCommand, uint8_t statusCommand) {
+	uart_ = uart;
+	commandLengths_ = commandLengths;
+	for (int i = 0; i < NUM_COMMANDS; i++) {
+		commandTimeouts_[i] = commandTimeouts[i];
+	}
+	maxValidCommand_ = maxValidCommand;
+	statusCommand_ = statusCommand;
+	head_ = 0;
+	tail_ = 0;
+	active_ = false;
+	holding_ = false;
+	servicing_ = false;
+	for (int i = 0; i < QUEUE_SIZE; i++) {
+		transactions_[i].state = TRANSACTION_FREE;
+		transactions_[i].id = INVALID_TRANSACTION;
+	}
+}
+void BusTransactionEngine::setReadiness(ReadinessModel* readiness) {
+	readiness_ = readiness;
+}
+void BusTransactionEngine::setBusCore(BusCore* core) {
+	core_ = core;
+}
+uint16_t BusTransactionEngine::submit(uint8_t address, uint8_t command, uint8_t data1, uint8_t data2, uint8_t flags,
+                                      BusTransactionCallback callback, void* context, uint16_t timeout) {
+	if (full()) {
+		return INVALID_TRANSACTION;
+	}
+	BusTransaction& transaction = slot(tail_++);
+	transaction.id = nextId_++;
+	if (nextId_ == INVALID_TRANSACTION) {
+		nextId_ = 0;
+	}
+	transaction.address = address;
+	transaction.command = command;
+	transaction.data1 = data1;
+	transaction.data2 = data2;
+	transaction.flags = flags;
+	transaction.state = TRANSACTION_QUEUED;
+	transaction.response = 0;
+	transaction.status = 0;
+	transaction.error = 0;
+	transaction.failIndex = 0;
+	transaction.timedOut = false;
+	transaction.timeout = timeout ? timeout : getCommandTimeout(command);
+	transaction.callback = callback;
+	transaction.context = context;
+	if (core_) {
+		// Can't fail - the core holds no more than this queue does
+		core_->post(transaction);
+	}
+
+	service();
+	return transaction.id;
+}
+void BusTransactionEngine::service() {
+	// Callbacks may submit further transactions
+	if (servicing_) {
+		return;
+	}
+	servicing_ = true;
+	if (core_) {
+		collect();
+	}
+	else {
+		step();
+	}
+	servicing_ = false;
+}
+void BusTransactionEngine::step() {
+	while (true) {
+		if (!active_ && !start()) {
+			return;
+		}
+		if (holding_) {
+			if ((int32_t)(time_us_32() - holdUntil_) < 0) {
+				return;
+			}
+			holding_ = false;
+		}
+		if (awaitingReply_) {
+			if (!uart_->available()) {
+				if ((int32_t)(time_us_32() - replyDeadline_) < 0) {
+					return;
+				}
+				handleTimeout();
+				continue;
+			}
+			if (uart_->echoMasked()) {
+				// The PIO drops our echo and tags the reply with the word it answers
+				uint32_t tagged = uart_->readTagged();
+				if (!Uart9Bit::taggedIsReply(tagged) || (Uart9Bit::taggedWord(tagged) != sentWord_)) {
+					continue; // Someone else's traffic, or a late reply to an earlier word
+				}
+				awaitingReply_ = false;
+				handleReply(Uart9Bit::taggedFramingError(tagged) ? FRAMING_ERROR : Uart9Bit::taggedReply(tagged));
+				continue;
+			}
+			uint16_t word = uart_->read();
+			if (echoPending_) { // Ignore self-transmission
+				// Anything else is a late reply to an earlier word
+				if (word == sentWord_) {
+					echoPending_ = false;
+				}
+				continue;
+			}
+			awaitingReply_ = false;
+			handleReply(word);
+			continue;
+		}
+		sendNext();
+	}
+}
+BusTransaction BusTransactionEngine::wait(uint16_t id) {
+	while (!isDone(id)) {
+		service();
+	}
+	const BusTransaction* transaction = find(id);
+	if (transaction) {
+		return *transaction;
+	}
+	// Recycled by later submissions - the result is gone
+	BusTransaction recycled = {};
+	recycled.id = id;
+	recycled.state = TRANSACTION_FREE;
+	return recycled;
+}
+void BusTransactionEngine::flush() {
+	while (!idle()) {
+		service();
+	}
+}
+void BusTransactionEngine::cancelPending() {
+	if (core_) {
+		// Only the core knows which has started. The rest come back cancelled.
+		core_->cancelPending();
+		service();
+		return;
+	}
+	uint16_t index = head_;
+	if (active_) {
+		index++;
+	}
+	for (; index != tail_; index++) {
+		BusTransaction& transaction = slot(index);
+		transaction.state = TRANSACTION_CANCELLED;
+		if (transaction.callback) {
+			transaction.callback(transaction, transaction.context);
+		}
+	}
+	tail_ = active_ ? head_ + 1 : head_;
+}
+const BusTransaction* BusTransactionEngine::find(uint16_t id) {
+	for (int i = 0; i < QUEUE_SIZE; i++) {
+		if (transactions_[i].id == id) {
+			return &transactions_[i];
+		}
+	}
+	return NULL;
+}
+bool BusTransactionEngine::isDone(uint16_t id) {
+	const BusTransaction* transaction = find(id);
+	if (!transaction) {
+		return true;
+	}
+	return (transaction->state != TRANSACTION_QUEUED) && (transaction->state != TRANSACTION_ACTIVE);
+}
+bool BusTransactionEngine::full() {
+	return (uint16_t)(tail_ - head_) >= QUEUE_SIZE;
+}
+bool BusTransactionEngine::idle() {
+	return head_ == tail_;
+}
+uint8_t BusTransactionEngine::pending() {
+	return tail_ - head_;
+}
+uint16_t BusTransactionEngine::getCommandTimeout(uint8_t command) {
+	return commandTimeouts_[command % NUM_COMMANDS];
+}
+void BusTransactionEngine::setCommandTimeout(uint8_t command, uint16_t timeout) {
+	commandTimeouts_[command % NUM_COMMANDS] = timeout;
+}
+
+bool BusTransactionEngine::start() {
+	while (!idle()) {
+		BusTransaction& transaction = slot(head_);
+
+		// Check if command is valid
+		if (transaction.command > maxValidCommand_) {
+			transaction.error = 0x13;
+			transaction.response = transaction.command;
+			finish(TRANSACTION_FAILED);
+			continue;
+		}
+		transaction.state = TRANSACTION_ACTIVE;
+		active_ = true;
+		statusPhase_ = (transaction.flags & TRANSACTION_QUERY_STATUS) && (transaction.command != statusCommand_) &&
+		               (!readiness_ || readiness_->uncertain(time_us_32()));
+		part_ = 0;
+		holding_ = false;
+		backoff_ = READY_BACKOFF_MIN;
+		statusStart_ = time_us_32();
+		awaitingReply_ = false;
+		echoPending_ = false;
+		return true;
+	}
+	return false;
+}
+void BusTransactionEngine::sendNext() {
+	BusTransaction& transaction = slot(head_);
+	uint16_t word;
+	switch (part_) {
+		case 0:
+			word = transaction.address + WW_ADDRESS_BIT;
+			break;
+		case 1:
+			word = statusPhase_ ? statusCommand_ : transaction.command;
+			break;
+		case 2:
+			word = transaction.data1;
+			break;
+		default:
+			word = transaction.data2;
+			break;
+	}
+	uart_->write(word);
+	sentWord_ = word;
+	replyDeadline_ = time_us_32() + (uint32_t)transaction.timeout * 1000;
+	awaitingReply_ = true;
+	echoPending_ = true;
+}
+void BusTransactionEngine::handleTimeout() {
+	// Drop any partial word, so that it can't be taken for the next reply
+	uart_->restartRx();
+	awaitingReply_ = false;
+	echoPending_ = false;
+	handleReply(NO_REPLY);
+}
+void BusTransactionEngine::handleReply(uint16_t reply) {
+	BusTransaction& transaction = slot(head_);
+	bool ignoreErrors = transaction.flags & TRANSACTION_IGNORE_ERRORS;
+
+	if ((reply == NO_REPLY) && !ignoreErrors) {
+		transaction.response = reply;
+		transaction.error = 0x11;
+		transaction.failIndex = part_;
+		transaction.timedOut = true;
+		finish(TRANSACTION_FAILED);
+		return;
+	}
+
+	if (statusPhase_) {
+		if (part_ == 1) {
+			transaction.status = reply;
+			part_ = 0;
+			statusPhase_ = !handleStatus(reply);
+		}
+		else {
+			part_++;
+		}
+		return;
+	}
+
+	uint8_t commandLength = commandLengths_[transaction.command];
+	transaction.response = reply;
+
+	// The reply to the last byte is the response
+	if (part_ >= commandLength) {
+		finish(TRANSACTION_COMPLETE);
+		return;
+	}
+	if (!ignoreErrors && (reply != 0)) { // Bad ACK
+		transaction.error = 0x11;
+		transaction.failIndex = part_;
+		finish(TRANSACTION_FAILED);
+		return;
+	}
+	part_++;
+}
+bool BusTransactionEngine::handleStatus(uint16_t status) {
+	// Without a model the status is informational, and no reply is left to the command to fail on
+	if (!readiness_ || (status == NO_REPLY)) {
+		return true;
+	}
+	if (status == 0) {
+		readiness_->synced(time_us_32());
+		return true;
+	}
+	if ((time_us_32() - statusStart_) > (uint32_t)READY_TIMEOUT * 1000) {
+		return true;
+	}
+	// Still busy - poll again later
+	holding_ = true;
+	holdUntil_ = time_us_32() + backoff_;
+	backoff_ *= 2;
+	if (backoff_ > READY_BACKOFF_MAX) {
+		backoff_ = READY_BACKOFF_MAX;
+	}
+	return false;
+}
+void BusTransactionEngine::finish(bus_transaction_state state) {
+	BusTransaction& transaction = slot(head_);
+	transaction.state = state;
+	if (readiness_) {
+		if (state == TRANSACTION_COMPLETE) {
+			readiness_->accepted(transaction.command, transaction.data1, transaction.data2, time_us_32());
+		}
+		else {
+			readiness_->lost();
+		}
+	}
+	head_++;
+	active_ = false;
+	if (transaction.callback) {
+		transaction.callback(transaction, transaction.context);
+	}
+
+	if ((state == TRANSACTION_FAILED) && (transaction.flags & TRANSACTION_HALT_ON_ERROR)) {
+		// Cancel the rest of the batch
+		while (!idle() && (slot(head_).flags & TRANSACTION_HALT_ON_ERROR)) {
+			BusTransaction& cancelled = slot(head_++);
+			cancelled.state = TRANSACTION_CANCELLED;
+			if (cancelled.callback) {
+				cancelled.callback(cancelled, cancelled.context);
+			}
+		}
+	}
+}
+void BusTransactionEngine::collect() {
+	if (core_->runInline()) {
+		core_->run();
+	}
+	// Results come back in the order the transactions were submitted
+	BusTransaction result;
+	while (core_->takeResult(result)) {
+		BusTransaction& transaction = slot(head_++);
+		transaction.state = result.state;
+		transaction.response = result.response;
+		transaction.status = result.status;
+		transaction.error = result.error;
+		transaction.failIndex = result.failIndex;
+		transaction.timedOut = result.timedOut;
+		if (transaction.callback) {
+			transaction.callback(transaction, transaction.context);
+		}
+	}
+}
@@ -0,0 +1,171 @@
+// Non-blocking bus transaction engine for the Wheelwriter
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+// Commands are queued as transactions and stepped through the half-duplex
+// address/command/data/ACK exchange from service(), which never blocks. Each
+// byte is sent as soon as the previous one is acknowledged, and the next
+// transaction is started as soon as the current one completes, so producers
+// can run ahead of the mechanism without any dead time between commands.
+//
+// Every word sent must be answered within the transaction's timeout (from the
+// per-command table, unless given at submit()). Otherwise the transaction
+// fails with a NACK/timeout error, or carries on with the next byte if it
+// ignores errors, so a silent bus can't stall the queue.
+//
+// If the UART is echo-masked, replies are matched against the word they
+// answer, so a lost or late reply can't be taken for the ACK of the next byte.
+//
+// With a ReadinessModel set, the status query requested by a transaction is
+// only sent when the model can't predict whether the mechanism is still busy.
+// If the status then comes back busy, it is polled again with a doubling
+// backoff until it clears (or READY_TIMEOUT ms pass) before the command goes.
+//
+// With a BusCore set, the transactions are run by the engine on the other core
+// instead. This one just keeps the queue, hands each transaction over as it is
+// submitted, and fills in the result and calls the callback (on this core)
+// when it comes back.
+//
+#pragma once
+
+#ifdef WHEELWRITER_SIM
+#include "SimUart9Bit.h"
+#else
+#include "uart_9bit/Uart9bit.h"
+#endif
+
+namespace wheelwriter {
+
+class ReadinessModel;
+class BusCore;
+
+enum bus_transaction_state {
+	TRANSACTION_FREE = 0,
+	TRANSACTION_QUEUED,
+	TRANSACTION_ACTIVE,
+	TRANSACTION_COMPLETE,
+	TRANSACTION_FAILED,
+	TRANSACTION_CANCELLED
+};
+
+enum bus_transaction_flags {
+	TRANSACTION_IGNORE_ERRORS = 0x01,  // Send every byte, even if not ACKed
+	TRANSACTION_HALT_ON_ERROR = 0x02,  // On failure, cancel the following halt-on-error transactions
+	TRANSACTION_QUERY_STATUS = 0x04    // Query the status before sending the command, if the readiness model needs it
+};
+
+struct BusTransaction;
+typedef void (*BusTransactionCallback)(const BusTransaction& transaction, void* context);
+
+struct BusTransaction {
+	uint16_t id;
+	uint8_t address;
+	uint8_t command;
+	uint8_t data1;
+	uint8_t data2;
+	uint8_t flags;
+	bus_transaction_state state;
+	uint16_t response;
+	uint8_t status;     // Reply to the status query, if requested
+	uint8_t error;      // 0x11: bad ACK, 0x13: invalid command
+	uint8_t failIndex;  // Byte that failed (0: address, 1: command, 2: data1, 3: data2)
+	bool timedOut;      // The failed byte wasn't answered at all
+	uint16_t timeout;   // Milliseconds to wait for each reply
+	BusTransactionCallback callback;
+	void* context;
+};
+
+class BusTransactionEngine {
+public:
+	static const uint16_t INVALID_TRANSACTION = 0xffff;
+	// Response of a transaction that timed out
+	static const uint16_t NO_REPLY = 0xfffe;
+
+	static const uint8_t NUM_COMMANDS = 16;
+	// Status polling backoff, in microseconds
+	static const uint32_t READY_BACKOFF_MIN = 500;
+	static const uint32_t READY_BACKOFF_MAX = 16000;
+	// Longest the status is polled for before the command is sent anyway, in milliseconds
+	static const uint16_t READY_TIMEOUT = 2000;
+
+	BusTransactionEngine() : uart_(NULL), readiness_(NULL), core_(NULL), head_(0), tail_(0), nextId_(0), 
+	                         active_(false), servicing_(false) {}
+	// commandLengths and commandTimeouts (milliseconds) are indexed by command
+	void init(Uart9Bit* uart, const uint8_t* commandLengths, const uint16_t* commandTimeouts,
+	          uint8_t maxValidCommand, uint8_t statusCommand);
+	// Skips status queries the model doesn't need, and keeps it up to date. NULL
+	// queries the status before every command that asks for it.
+	void setReadiness(ReadinessModel* readiness);
+	// Has the transactions run by core instead, which must already be set up
+	// with the UART and readiness model. The queue must be empty. NULL runs them here.
+	void setBusCore(BusCore* core);
+
+	// Queues a transaction. A timeout of 0 uses the command's entry in the
+	// timeout table. Returns its handle or INVALID_TRANSACTION if the queue is full.
+	uint16_t submit(uint8_t address, uint8_t command, uint8_t data1, uint8_t data2, uint8_t flags=0,
+	                BusTransactionCallback callback=NULL, void* context=NULL, uint16_t timeout=0);
+	// Steps the active transaction as far as it can go without blocking
+	void service();
+	// Services the queue until the transaction finishes, then returns a copy of it
+	BusTransaction wait(uint16_t id);
+	// Services the queue until it is empty
+	void flush();
+	// Cancels all queued transactions. The active transaction is allowed to finish.
+	void cancelPending();
+
+	// Returns the transaction if it is still held by the queue, NULL if it has been recycled
+	const BusTransaction* find(uint16_t id);
+	bool isDone(uint16_t id);
+	bool full();
+	bool idle();
+	uint8_t pending();
+
+	uint16_t getCommandTimeout(uint8_t command);
+	void setCommandTimeout(uint8_t command, uint16_t timeout);
+
+	static const uint8_t QUEUE_SIZE = 32;
+
+private:
+	BusTransaction& slot(uint16_t index) {
+		return transactions_[index % QUEUE_SIZE];
+	}
+	void step();
+	bool start();
+	void sendNext();
+	void handleReply(uint16_t reply);
+	void handleTimeout();
+	void finish(bus_transaction_state state);
+	// Handles the reply to the status query. Returns true once the command can go.
+	bool handleStatus(uint16_t status);
+	// Takes the results the bus core has finished with
+	void collect();
+
+	Uart9Bit* uart_;
+	ReadinessModel* readiness_;
+	BusCore* core_;
+	const uint8_t* commandLengths_;
+	uint16_t commandTimeouts_[NUM_COMMANDS];
+	uint8_t maxValidCommand_;
+	uint8_t statusCommand_;
+
+	BusTransaction transactions_[QUEUE_SIZE];
+	uint16_t head_;   // Index of the oldest unfinished transaction
+	uint16_t tail_;   // Index of the next free slot
+	uint16_t nextId_;
+
+	// Active transaction state
+	bool active_;
+	bool servicing_;
+	bool statusPhase_;    // Sending the status query
+	uint8_t part_;        // Part of the command being sent (0: address .. 3: data2)
+	bool awaitingReply_;
+	bool echoPending_;    // Our own transmission is still to be read back
+	uint16_t sentWord_;   // Word awaiting a reply
+	uint32_t replyDeadline_;  // time_us_32() by which the reply must be in
+	bool holding_;            // Waiting to poll the status again
+	uint32_t holdUntil_;      // time_us_32() to poll it at
+	uint32_t backoff_;        // Microseconds until the next poll
+	uint32_t statusStart_;    // time_us_32() of the first poll
+};
+
+} // namespace wheelwriter
@@ -51,7 +51,7 @@ public:
     }
     Serial.println("Programming " + String(blocksToProgram) + " blocks at address " + String(blockIndex));
     char* bufferEnd = buffer + dataSize;
-    for (int i = 0; i < blocksToProgram; i++) {
+    for (size_t i = 0; i < blocksToProgram; i++) {
       char* programBuffer = new char[programBlockSize_]();
       char* start = buffer + programBlockSize_ * i;
       size_t sizeToCopy = programBlockSize_;
@@ -62,6 +62,7 @@ public:
       programBlock(blockIndex + i, programBuffer, programBlockSize_);
       delete[] programBuffer;
     }
+    return blocksToProgram;
   }
   int eraseBlock(size_t blockIndex) {
     Serial.println("Erasing block at " + String(blockIndex));
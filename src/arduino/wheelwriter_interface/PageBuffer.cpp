@@ -0,0 +1,56 @@
+// Page buffer for laying out a page before it is typed
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+#include "PageBuffer.h"
+#include "Wheelwriter.h"
+#include <algorithm>
+
+using namespace wheelwriter;
+
+bool PageBuffer::place(int16_t x, int16_t y, uint8_t wheelPosition) {
+	if ((x < 0) || (x >= width_) || (y < 0) || (y >= length_) || (glyphs_.size() >= WW_PAGE_GLYPHS_MAX)) {
+		return false;
+	}
+	glyphs_.push_back({x, y, wheelPosition});
+	return true;
+}
+bool PageBuffer::placeAscii(int16_t x, int16_t y, char ascii) {
+	return place(x, y, typewriter_.ascii2Printwheel(ascii));
+}
+int16_t PageBuffer::placeAsciiString(int16_t x, int16_t y, const char* string, uint8_t advanceUsteps) {
+	for (; *string; string++) {
+		uint8_t wheelPosition = typewriter_.ascii2Printwheel(*string);
+		if (wheelPosition) {
+			place(x, y, wheelPosition);
+		}
+		x += advanceUsteps;
+	}
+	return x;
+}
+void PageBuffer::render() {
+	// Rows top to bottom, each left to right. Overstrikes stay in the order placed.
+	std::stable_sort(glyphs_.begin(), glyphs_.end(), [](const PageGlyph& a, const PageGlyph& b) {
+		return (a.y != b.y) ? (a.y < b.y) : (a.x < b.x);
+	});
+	size_t end;
+	for (size_t begin = 0; begin < glyphs_.size(); begin = end) {
+		for (end = begin + 1; (end < glyphs_.size()) && (glyphs_[end].y == glyphs_[begin].y); end++);
+		typewriter_.movePlatenTo(glyphs_[begin].y);
+		int16_t x = typewriter_.horizontalMicrospaces();
+		if (abs(x - glyphs_[end - 1].x) < abs(x - glyphs_[begin].x)) {
+			std::stable_sort(glyphs_.begin() + begin, glyphs_.begin() + end,
+			                 [](const PageGlyph& a, const PageGlyph& b) { return a.x > b.x; });
+		}
+		// Moves only set the logical position, so the typewriter puts a gap to
+		// the right in the advance field of the glyph before
+		for (size_t i = begin; i < end; i++) {
+			typewriter_.moveCarriage((int16_t)(glyphs_[i].x - typewriter_.horizontalMicrospaces()));
+			typewriter_.typeCharacter(glyphs_[i].wheelPosition, 0);
+		}
+	}
+	typewriter_.carriageReturn();
+}
+void PageBuffer::clear() {
+	glyphs_.clear();
+}
@@ -0,0 +1,72 @@
+// Page buffer for laying out a page before it is typed
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+// Glyphs are placed anywhere on the page, in any order, in carriage (x) and
+// platen (y) microspaces from the left margin and the top of the page (see
+// Wheelwriter::setLeftMargin() and setTopOfPage()). Glyphs placed at the same
+// position are overstruck, and rows a fraction of a line apart give
+// superscripts and subscripts. render() then types the page a row at a time,
+// top to bottom, so the platen never reverses. Each row is typed from
+// whichever end is nearer the carriage, so the carriage sweeps back and forth
+// rather than returning to the margin for every row.
+//
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace wheelwriter {
+
+class Wheelwriter;
+
+// US Letter, at 120 carriage and 96 platen microspaces per inch
+static const int16_t WW_PAGE_WIDTH = 1020;
+static const int16_t WW_PAGE_LENGTH = 1056;
+// Glyphs a page buffer holds - a full page of 12 pitch text is about 6600
+static const uint16_t WW_PAGE_GLYPHS_MAX = 8192;
+
+class PageBuffer {
+public:
+	PageBuffer(Wheelwriter& typewriter, int16_t width=WW_PAGE_WIDTH, int16_t length=WW_PAGE_LENGTH) :
+		typewriter_(typewriter), width_(width), length_(length) {}
+
+	// Places a glyph (printwheel position) at x, y. Returns false if it is off
+	// the page or the buffer is full.
+	bool place(int16_t x, int16_t y, uint8_t wheelPosition);
+	bool placeAscii(int16_t x, int16_t y, char ascii);
+	// Places a string from x, advancing advanceUsteps per character. Spaces
+	// are skipped. Returns the x after the string.
+	int16_t placeAsciiString(int16_t x, int16_t y, const char* string, uint8_t advanceUsteps);
+	// Types the page, then returns the carriage to the left margin. The
+	// platen is left on the last row. The buffer is kept until clear().
+	void render();
+	void clear();
+	size_t size() const {
+		return glyphs_.size();
+	}
+	bool empty() const {
+		return glyphs_.empty();
+	}
+	int16_t width() const {
+		return width_;
+	}
+	int16_t length() const {
+		return length_;
+	}
+
+private:
+	struct PageGlyph {
+		int16_t x;
+		int16_t y;
+		uint8_t wheelPosition;
+	};
+
+	Wheelwriter& typewriter_;
+	int16_t width_;
+	int16_t length_;
+	std::vector<PageGlyph> glyphs_;
+};
+
+} // namespace wheelwriter
@@ -102,7 +102,7 @@ int ParameterStorage::storeParametersToFlash(bool force, bool dryRun) {
 
   Serial.println("\nBuffer");
   Serial.println("------");
-  for (int i = 0; i < numBlocks; i++) {
+  for (size_t i = 0; i < numBlocks; i++) {
     Serial.print("Block " + String(i) + ": ");
     Serial.println(buffer+i*storageBlockLength_);
   }
@@ -134,4 +134,5 @@ int ParameterStorage::printParameters(bool hidePasswords) {
     }
     paramIdx++;
   }
+  return paramIdx;
 }
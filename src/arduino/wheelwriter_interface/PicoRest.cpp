@@ -3,38 +3,90 @@
 //
 #include <Arduino.h>
 #include <WiFiNINA.h>
+#include <algorithm>
+#include <ctype.h>
+#include <string.h>
 
 #include "PicoRest.h"
 
 namespace PicoRest {
 
-int HttpRequest::parseChar(char c) {
-  switch (parseState) {
-    case (REQUEST):
-    case (HEADER): {
-      if (c == '\n') {
-        parseLine(buffer);
-        numHeaderLines++;
-        buffer.clear();
-      }
-      else {
-        if (c != '\r') {
-          buffer += c;
-        }
-      }
-      return 1;
+// Header names and methods are matched whole, ignoring case
+static bool equalsIgnoreCase(std::string_view a, const char* b) {
+  size_t length = strlen(b);
+  if (a.length() != length) {
+    return false;
+  }
+  for (size_t i = 0; i < length; i++) {
+    if (tolower(a[i]) != tolower(b[i])) {
+      return false;
     }
-    case (CONTENT): {
-      content += c;
-      if (content.length() == contentLength) {
-        parseState = DONE;
+  }
+  return true;
+}
+static std::string_view trim(std::string_view value) {
+  while (!value.empty() && ((value.front() == ' ') || (value.front() == '\t'))) {
+    value.remove_prefix(1);
+  }
+  while (!value.empty() && ((value.back() == ' ') || (value.back() == '\t'))) {
+    value.remove_suffix(1);
+  }
+  return value;
+}
+static void printView(std::string_view view) {
+  Serial.write(view.data(), view.length());
+  Serial.println();
+}
+
+void HttpRequest::reset() {
+  method = GET;
+  numHeaderLines = 0;
+  path = host = userAgent = contentType = content = std::string_view();
+  contentLength = 0;
+  keepAlive = false;
+  parseState = REQUEST;
+  error = false;
+  errorStatus = HttpResponse::StatusCode::BAD_REQUEST;
+  length_ = scanned_ = parsed_ = 0;
+  haveContentLength_ = false;
+}
+void HttpRequest::next() {
+  size_t end = (parseState == DONE) ? parsed_ + contentLength : length_;
+  size_t remaining = length_ - end;
+  memmove(buffer_, buffer_ + end, remaining);
+  reset();
+  length_ = remaining;
+}
+bool HttpRequest::parse(size_t length) {
+  length_ += length;
+  while ((parseState == REQUEST) || (parseState == HEADER)) {
+    const char* end = (const char*)memchr(buffer_ + scanned_, '\n', length_ - scanned_);
+    if (!end) {
+      scanned_ = length_;
+      if (!readSpace()) {
+        return fail(HttpResponse::StatusCode::CONTENT_TOO_LARGE);
       }
-      return 1;
-    } 
-    case (DONE): {
-      return 0;
+      return false;
+    }
+    std::string_view line(buffer_ + parsed_, end - (buffer_ + parsed_));
+    if (!line.empty() && (line.back() == '\r')) {
+      line.remove_suffix(1);
+    }
+    parsed_ = scanned_ = end + 1 - buffer_;
+    if (!parseLine(line)) {
+      return true;
     }
   }
+  if ((parseState == CONTENT) && (length_ - parsed_ >= contentLength)) {
+    content = std::string_view(buffer_ + parsed_, contentLength);
+    parseState = DONE;
+  }
+  return parseState == DONE;
+}
+bool HttpRequest::fail(HttpResponse::StatusCode status) {
+  error = true;
+  errorStatus = status;
+  return true;
 }
 void HttpRequest::print() {
   Serial.println("\nHTTP request");
@@ -45,6 +97,10 @@ void HttpRequest::print() {
       Serial.println("GET");
       break;
     }
+    case HEAD: {
+      Serial.println("HEAD");
+      break;
+    }
     case POST: {
       Serial.println("POST");
       break;
@@ -59,83 +115,126 @@ void HttpRequest::print() {
     }
   }
   Serial.print("--> Path: ");
-  Serial.println(path.c_str());
+  printView(path);
   Serial.print("--> Host: ");
-  Serial.println(host.c_str());
+  printView(host);
   Serial.print("--> User-Agent: ");
-  Serial.println(userAgent.c_str());
+  printView(userAgent);
   Serial.print("--> Content-Type: ");
-  Serial.println(contentType.c_str());
+  printView(contentType);
   Serial.print("--> Content-Length: ");
   Serial.println(contentLength);
   Serial.print("--> Content: ");
-  Serial.println(content.c_str());
+  printView(content);
 }
-int HttpRequest::parseLine(const std::string& line) {
-  switch (parseState) {
-    case (REQUEST): {
-      return parseRequest(line);
-    }
-    case (HEADER): {
-      return parseHeader(line);
-    }
-    default: {
-      error = true;
-      return 0;
-    }
+// Each returns false if the request has failed
+bool HttpRequest::parseLine(std::string_view line) {
+  numHeaderLines++;
+  if (parseState == REQUEST) {
+    return parseRequest(line);
   }
+  return parseHeader(line);
 }
-int HttpRequest::parseRequest(const std::string& line) {
-  if (line.find("GET") != std::string::npos) {
-    method = GET;
-  } else if (line.find("POST") != std::string::npos) {
-    method = POST;
-  } else if (line.find("PUT") != std::string::npos) {
-    method = PUT;
-  } else if (line.find("DELETE") != std::string::npos) {
-    method = DELETE;
-  } else {
-    error = true;
-    return 0;
+bool HttpRequest::parseRequest(std::string_view line) {
+  static const struct {
+    const char* name;
+    Method method;
+  } methods[] = {{"GET", GET}, {"HEAD", HEAD}, {"POST", POST}, {"PUT", PUT}, {"DELETE", DELETE}};
+
+  if (line.empty()) {
+    // Blank lines ahead of the request are allowed
+    numHeaderLines--;
+    return true;
+  }
+  size_t methodEnd = line.find(' ');
+  size_t pathEnd = (methodEnd == std::string_view::npos) ? methodEnd : line.find(' ', methodEnd + 1);
+  if ((pathEnd == std::string_view::npos) || (pathEnd == methodEnd + 1)) {
+    return !fail(HttpResponse::StatusCode::BAD_REQUEST);
+  }
+  std::string_view version = line.substr(pathEnd + 1);
+  if ((version.length() < 5) || !equalsIgnoreCase(version.substr(0, 5), "HTTP/")) {
+    return !fail(HttpResponse::StatusCode::BAD_REQUEST);
+  }
+  std::string_view name = line.substr(0, methodEnd);
+  size_t i = 0;
+  while ((i < sizeof(methods) / sizeof(methods[0])) && !equalsIgnoreCase(name, methods[i].name)) {
+    i++;
+  }
+  if (i == sizeof(methods) / sizeof(methods[0])) {
+    return !fail(HttpResponse::StatusCode::NOT_IMPLEMENTED);
   }
-  size_t start = line.find(" ") + 1;
-  size_t end = line.find(" ", start);
-  path = line.substr(start, end - start);
+  method = methods[i].method;
+  path = line.substr(methodEnd + 1, pathEnd - methodEnd - 1);
+  // HTTP/1.1 keeps the connection open unless told otherwise, and 1.0 closes it
+  keepAlive = !equalsIgnoreCase(version, "HTTP/1.0");
   parseState = HEADER;
-  return 1;
+  return true;
 }
-int HttpRequest::parseHeader(const std::string& line) {
-  if (line.length() == 0) {
-    if (contentLength != 0) {
-      parseState = CONTENT;
+bool HttpRequest::parseHeader(std::string_view line) {
+  if (line.empty()) {
+    if (contentLength > BUFFER_SIZE - parsed_) {
+      return !fail(HttpResponse::StatusCode::CONTENT_TOO_LARGE);
+    }
+    parseState = contentLength ? CONTENT : DONE;
+    return true;
+  }
+  size_t colon = line.find(':');
+  if (!colon || (colon == std::string_view::npos)) {
+    return !fail(HttpResponse::StatusCode::BAD_REQUEST);
+  }
+  std::string_view name = line.substr(0, colon);
+  std::string_view value = trim(line.substr(colon + 1));
+  if (equalsIgnoreCase(name, "Host")) {
+    host = value;
+  } else if (equalsIgnoreCase(name, "User-Agent")) {
+    userAgent = value;
+  } else if (equalsIgnoreCase(name, "Content-Type")) {
+    contentType = value;
+  } else if (equalsIgnoreCase(name, "Content-Length")) {
+    if (value.empty()) {
+      return !fail(HttpResponse::StatusCode::BAD_REQUEST);
+    }
+    size_t length = 0;
+    for (char c : value) {
+      if ((c < '0') || (c > '9')) {
+        return !fail(HttpResponse::StatusCode::BAD_REQUEST);
+      }
+      // Anything past the buffer is too large, so there is no need to count further
+      if (length <= BUFFER_SIZE) {
+        length = length * 10 + (c - '0');
+      }
+    }
+    if (haveContentLength_ && (length != contentLength)) {
+      return !fail(HttpResponse::StatusCode::BAD_REQUEST);
     }
-    else {
-      parseState = DONE;
+    contentLength = length;
+    haveContentLength_ = true;
+  } else if (equalsIgnoreCase(name, "Connection")) {
+    while (!value.empty()) {
+      size_t end = value.find(',');
+      std::string_view option = trim(value.substr(0, end));
+      if (equalsIgnoreCase(option, "close")) {
+        keepAlive = false;
+      } else if (equalsIgnoreCase(option, "keep-alive")) {
+        keepAlive = true;
+      }
+      value.remove_prefix((end == std::string_view::npos) ? value.length() : end + 1);
     }
-    return 2;
-  }
-  if (line.find("Host") != std::string::npos) {
-    size_t start = line.find(":") + 2;
-    host = line.substr(start);
-  } else if (line.find("User-Agent") != std::string::npos) {
-    size_t start = line.find(":") + 2;
-    userAgent = line.substr(start);
-  } else if (line.find("Content-Type") != std::string::npos) {
-    size_t start = line.find(":") + 2;
-    contentType = line.substr(start);
-  } else if (line.find("Content-Length") != std::string::npos) {
-    size_t start = line.find(":") + 2;
-    contentLength = std::stoi(line.substr(start));
+  } else if (equalsIgnoreCase(name, "Transfer-Encoding")) {
+    // Chunked content isn't supported
+    return !fail(HttpResponse::StatusCode::NOT_IMPLEMENTED);
   }
-  return 1;
+  return true;
 }
 
 const std::map<HttpResponse::StatusCode, std::string> HttpResponse::statusStrings = { 
     { OK, "OK" },
+    { ACCEPTED, "Accepted" },
     { BAD_REQUEST, "Bad Request" },
     { FORBIDDEN, "Forbidden" },
     { NOT_FOUND, "Not Found" },
     { METHOD_NOT_ALLOWED, "Method Not Allowed" },
+    { CONFLICT, "Conflict" },
     { LENGTH_REQUIRED, "Length Required" },
     { CONTENT_TOO_LARGE, "Content Too Large" },
     { INTERNAL_SERVER_ERROR, "Internal Server Error" },
@@ -163,6 +262,7 @@ int PicoRestApi::init() {
     Serial.println(WIFI_FIRMWARE_LATEST_VERSION);
     Serial.println("--> *** Please upgrade the firmware!");
   }
+  return 1;
 }
 int PicoRestApi::connect(const char* ssid, const char* password) {
   int retries = 3;
@@ -257,71 +357,94 @@ void PicoRestApi::printMacAddress() {
   }
 }
 int PicoRestApi::processClient() {
-  WiFiClient client = server_.available();
-
-  if (client) {
+  if (client_ && !client_.connected()) {
+    client_.stop();
+    Serial.println("\nClient disconnected.");
+  }
+  if (!client_) {
+    client_ = server_.available();
+    if (!client_) {
+      return 0;
+    }
     Serial.println("\n*** New WiFi client\n");
-    HttpRequest request;
+    request_.reset();
+    lastActivity_ = millis();
+  }
 
-    // Read the request from the client
-    while (client.connected()) {
-      if (client.available()) {
-        char c = client.read();
-        // Serial.write(c);
-        request.parseChar(c);
-        if (request.parseState == HttpRequest::DONE) {
-          break;
-        }
-      }
+  // Take what has arrived, as much at a time as there is. With nothing new,
+  // there may still be a pipelined request already read.
+  HttpRequest& request = request_;
+  bool finished;
+  int available = client_.available();
+  if (available > 0) {
+    int length = client_.read(request.readBuffer(), std::min((size_t)available, request.readSpace()));
+    lastActivity_ = millis();
+    finished = request.parse((length > 0) ? length : 0);
+  }
+  else {
+    // With the buffer full, this fails the request
+    finished = request.parse(0);
+  }
+  if (!finished) {
+    if (millis() - lastActivity_ > IDLE_TIMEOUT) {
+      Serial.println("--> Closing idle connection");
+      client_.stop();
     }
+    return 0;
+  }
 
-    if (request.error) {
-      Serial.println("--> Error parsing request");
-      return 0;
+  headRequest_ = false;
+  if (request.error) {
+    Serial.println("--> Error parsing request");
+    keepAlive_ = false;
+    sendGenericResponse(client_, request.errorStatus);
+    client_.stop();
+    return 0;
+  }
+  keepAlive_ = request.keepAlive;
+  headRequest_ = (request.method == HttpRequest::HEAD);
+
+  if ((request.method == HttpRequest::POST) || (request.method == HttpRequest::PUT)) {
+    Serial.println();
+  }
+  Serial.println("--> Request parsed");
+  request.print();
+
+  switch (request.method) {
+    case HttpRequest::GET: {
+      handleGetRequest(client_, request);
+      break;
     }
-    if (request.contentLength != request.content.length()) {
-      Serial.println("--> Content length mismatch! Expected " + String(request.contentLength) + " but got " + String(request.content.length()));
-      return 0;
+    case HttpRequest::HEAD: {
+      handleHeadRequest(client_, request);
+      break;
     }
-
-    if ((request.method == HttpRequest::POST) || (request.method == HttpRequest::PUT)) {
-      Serial.println();
+    case HttpRequest::POST: {
+      handlePostRequest(client_, request);
+      break;
     }
-    Serial.println("--> Request parsed");
-    request.print();
-
-    switch (request.method) {
-      case HttpRequest::GET: {
-        handleGetRequest(client, request);
-        break;
-      }
-      case HttpRequest::HEAD: {
-        handleHeadRequest(client, request);
-        break;
-      }
-      case HttpRequest::POST: {
-        handlePostRequest(client, request);
-        break;
-      }
-      case HttpRequest::PUT: {
-        handlePutRequest(client, request);
-        break;
-      }
-      case HttpRequest::DELETE: {
-        handleDeleteRequest(client, request);
-        break;
-      }
-      default: {
-        sendGenericResponse(client, HttpResponse::StatusCode::NOT_IMPLEMENTED);
-      }
+    case HttpRequest::PUT: {
+      handlePutRequest(client_, request);
+      break;
     }
+    case HttpRequest::DELETE: {
+      handleDeleteRequest(client_, request);
+      break;
+    }
+    default: {
+      sendGenericResponse(client_, HttpResponse::StatusCode::NOT_IMPLEMENTED);
+    }
+  }
 
-    // close the connection:
-    client.stop();
+  if (keepAlive_) {
+    request.next();
+    lastActivity_ = millis();
+  }
+  else {
+    client_.stop();
     Serial.println("\nClient disconnected.");
-    return 1;
   }
-  return 0;
+  return 1;
 }
 void PicoRestApi::handleGetRequest(WiFiClient& client, HttpRequest& request) {
   if (request.path == "/") {
@@ -332,14 +455,8 @@ void PicoRestApi::handleGetRequest(WiFiClient& client, HttpRequest& request) {
   }
 }
 void PicoRestApi::handleHeadRequest(WiFiClient& client, HttpRequest& request) {
-  if (request.path == "/") {
-    client.println("HTTP/1.1 200 OK");
-    client.println("Content-type:text/html");
-    client.println();
-  }
-  else {
-    sendGenericResponse(client, HttpResponse::StatusCode::NOT_FOUND);
-  }
+  // sendResponse() leaves the body out
+  handleGetRequest(client, request);
 }
 void PicoRestApi::handlePostRequest(WiFiClient& client, HttpRequest& request) {
   sendGenericResponse(client, HttpResponse::StatusCode::NOT_IMPLEMENTED);
@@ -351,25 +468,28 @@ void PicoRestApi::handleDeleteRequest(WiFiClient& client, HttpRequest& request)
   sendGenericResponse(client, HttpResponse::StatusCode::NOT_IMPLEMENTED);
 }
 void PicoRestApi::sendDefaultWebpage(WiFiClient& client) {
-  // HTTP response header
-  client.println("HTTP/1.1 200 OK");
-  client.println("Content-type:text/html");
-  client.println();
-
-  // HTML content
-  client.println("<!DOCTYPE html>");
-  client.println("<html>");
-  client.println("<body>");
-  client.println("<h1>PicoRestApi</h1>");
-  client.println("<p>Created by: <a href=https://github.com/jkua>John Kua</a></p>");
-  client.println("<p><a href=https://github.com/jkua/pico_rest>GitHub</a></p>");
-  client.println("</body>");
-  client.println("</html>");
+  sendResponse(client, HttpResponse::StatusCode::OK, 
+               "<!DOCTYPE html>\r\n"
+               "<html>\r\n"
+               "<body>\r\n"
+               "<h1>PicoRestApi</h1>\r\n"
+               "<p>Created by: <a href=https://github.com/jkua>John Kua</a></p>\r\n"
+               "<p><a href=https://github.com/jkua/pico_rest>GitHub</a></p>\r\n"
+               "</body>\r\n"
+               "</html>");
 }
 void PicoRestApi::sendGenericResponse(WiFiClient& client, HttpResponse::StatusCode status) {
   HttpResponse response(status);
-  client.println(response.header().c_str());
-  client.println(response.body().c_str());
+  sendResponse(client, status, response.body());
+}
+void PicoRestApi::sendResponse(WiFiClient& client, HttpResponse::StatusCode status, const std::string& body) {
+  HttpResponse response(status);
+  // One write, so that it goes to the WiFi module in as few transfers as it can
+  std::string message = response.header(body.length() + 2, keepAlive_);
+  if (!headRequest_) {
+    message += body + "\r\n";
+  }
+  client.write((const uint8_t*)message.data(), message.length());
 }
 
 } // namespace PicoRest
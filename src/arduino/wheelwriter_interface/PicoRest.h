@@ -4,6 +4,7 @@
 #pragma once 
 
 #include <string>
+#include <string_view>
 #include <map>
 
 #include <Arduino.h>
@@ -13,54 +14,16 @@ using namespace std::string_literals;
 
 namespace PicoRest {
 
-class HttpRequest {
-public:
-  HttpRequest() : numHeaderLines(0), parseState(REQUEST), contentLength(0), error(false) {}
-
-  int parseChar(char c);
-  void print();
-
-  enum Method {
-    GET,
-    HEAD,
-    POST,
-    PUT,
-    DELETE
-  } method;
-
-  size_t numHeaderLines;
-  std::string path;
-  std::string host;
-  std::string userAgent;
-  std::string contentType;
-  size_t contentLength;
-  std::string content;
-
-  enum ParseState {
-    REQUEST,
-    HEADER,
-    CONTENT,
-    DONE
-  } parseState;
-
-  bool error;
-
-private:
-  int parseLine(const std::string& line);
-  int parseRequest(const std::string& line);
-  int parseHeader(const std::string& line);
-
-  std::string buffer;
-};
-
 class HttpResponse {
 public:
   enum StatusCode {
     OK = 200,
+    ACCEPTED = 202,
     BAD_REQUEST = 400,
     FORBIDDEN = 403,
     NOT_FOUND = 404,
     METHOD_NOT_ALLOWED = 405,
+    CONFLICT = 409,
     LENGTH_REQUIRED = 411,
     CONTENT_TOO_LARGE = 413,
     INTERNAL_SERVER_ERROR = 500,
@@ -79,22 +42,108 @@ public:
     return std::to_string(status_) + " "s + statusStrings.at(status_);
   }
 
-  std::string header() {
-    return "HTTP/1.1 "s + statusString() + "\r\n"s + "Content-type:text/html\r\n"s;
+  // The status line and headers, up to and including the blank line. The body 
+  // that follows must be contentLength bytes.
+  std::string header(size_t contentLength, bool keepAlive) {
+    return "HTTP/1.1 "s + statusString() + "\r\n"s + "Content-type:text/html\r\n"s + 
+           "Content-Length: "s + std::to_string(contentLength) + "\r\n"s + 
+           (keepAlive ? "Connection: keep-alive\r\n"s : "Connection: close\r\n"s) + "\r\n"s;
   }
   std::string body() {
     return "<h1>"s + statusString() + "</h1>"s;
   }
 };
 
+// Parses a request as it arrives, from a buffer the connection reads into
+// directly, as much at a time as the socket has. The strings are views into the
+// buffer, so nothing is copied or allocated, and they last until reset() or
+// next().
+class HttpRequest {
+public:
+  // Largest request, headers and content together, that can be taken
+  static const size_t BUFFER_SIZE = 8192;
+
+  HttpRequest() {
+    reset();
+  }
+  void reset();
+  // Drops a finished request, keeping what has been read past its end: the 
+  // start of the next request, if the client has pipelined them
+  void next();
+
+  // Where to read more of the request to, and how much room there is
+  uint8_t* readBuffer() {
+    return (uint8_t*)buffer_ + length_;
+  }
+  size_t readSpace() {
+    return BUFFER_SIZE - length_;
+  }
+  // Parses the length bytes just read into readBuffer(). Returns true once the 
+  // request is complete, or has failed.
+  bool parse(size_t length);
+  void print();
+
+  enum Method {
+    GET,
+    HEAD,
+    POST,
+    PUT,
+    DELETE
+  } method;
+
+  size_t numHeaderLines;
+  std::string_view path;
+  std::string_view host;
+  std::string_view userAgent;
+  std::string_view contentType;
+  size_t contentLength;
+  std::string_view content;
+  // Whether the client wants the connection kept open afterwards, from the 
+  // version and Connection header
+  bool keepAlive;
+
+  enum ParseState {
+    REQUEST,
+    HEADER,
+    CONTENT,
+    DONE
+  } parseState;
+
+  bool error;
+  // Response for a request that failed: 400, 413 or 501
+  HttpResponse::StatusCode errorStatus;
+
+private:
+  bool parseLine(std::string_view line);
+  bool parseRequest(std::string_view line);
+  bool parseHeader(std::string_view line);
+  bool fail(HttpResponse::StatusCode status);
+
+  char buffer_[BUFFER_SIZE];
+  size_t length_;   // Read so far
+  size_t scanned_;  // Searched for the end of the line
+  size_t parsed_;   // Start of the next line, or of the content
+  bool haveContentLength_;
+};
+
+// Serves one connection at a time, and keeps it open between requests unless
+// the client asks otherwise. Requests pipelined on it are answered in order.
 class PicoRestApi {
 public:
-  PicoRestApi(WiFiServer& server) : server_(server), status_(WL_IDLE_STATUS) {}
+  // A connection with no request coming in for this long is closed, so that 
+  // other clients can connect (milliseconds)
+  static const uint32_t IDLE_TIMEOUT = 5000;
+
+  PicoRestApi(WiFiServer& server) : server_(server), status_(WL_IDLE_STATUS), lastActivity_(0), keepAlive_(false), 
+                                    headRequest_(false) {}
   int init();
   int connect(const char* ssid, const char* password);
   int listNetworks();
   void printWifiStatus();
   void printMacAddress();
+  // Reads what has arrived, taking a new connection if there is none, and 
+  // answers the next request once it is complete. Doesn't wait for anything to 
+  // arrive - call it from the main loop. Returns 1 if a request was answered.
   int processClient();
   virtual void handleGetRequest(WiFiClient& client, HttpRequest& request);
   virtual void handleHeadRequest(WiFiClient& client, HttpRequest& request);
@@ -103,11 +152,21 @@ public:
   virtual void handleDeleteRequest(WiFiClient& client, HttpRequest& request);
   virtual void sendDefaultWebpage(WiFiClient& client);
   void sendGenericResponse(WiFiClient& client, HttpResponse::StatusCode status);
+  // Sends the whole response, with the body followed by a line end. The body 
+  // is left out when answering HEAD.
+  void sendResponse(WiFiClient& client, HttpResponse::StatusCode status, const std::string& body);
 private:
   WiFiServer& server_;
   int status_;
   byte macAddress_[6];
   IPAddress ipAddress_;
+  // The one connection served at a time
+  WiFiClient client_;
+  HttpRequest request_;
+  uint32_t lastActivity_;
+  // For the request being answered
+  bool keepAlive_;
+  bool headRequest_;
 };
 
 } // namespace PicoRest
\ No newline at end of file
@@ -0,0 +1,366 @@
+// Print jobs, queued by the REST API and typed in the background
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+#include "PrintJobQueue.h"
+#include "Wheelwriter.h"
+#include <Arduino.h>
+
+using namespace wheelwriter;
+
+static const char* jobKindNames[] = {"type", "bufferTest", "printwheelSample"};
+static const char* jobStateNames[] = {"queued", "running", "paused", "done", "cancelled", "preempted"};
+static const char* jobPriorityNames[] = {"bulk", "normal", "urgent"};
+
+bool wheelwriter::parseJobPriority(std::string_view name, print_job_priority& priority) {
+	for (uint8_t i = 0; i < JOB_PRIORITIES; i++) {
+		if (name == jobPriorityNames[i]) {
+			priority = (print_job_priority)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+uint16_t PrintJobQueue::submitText(const std::string& text, print_job_priority priority) {
+	PrintJob job = {};
+	job.kind = JOB_TYPE;
+	job.text = text;
+	job.charsTotal = text.length();
+	for (char c : text) {
+		if (c == '\n') {
+			job.linesTotal++;
+		}
+	}
+	if (!text.empty() && (text.back() != '\n')) {
+		job.linesTotal++;
+	}
+	return _submit(job, priority);
+}
+uint16_t PrintJobQueue::submitBufferTest(uint16_t numChars, uint8_t charsPerLine, print_job_priority priority) {
+	if (!charsPerLine) {
+		return 0;
+	}
+	PrintJob job = {};
+	job.kind = JOB_BUFFER_TEST;
+	job.parameter1 = charsPerLine;
+	job.charsTotal = numChars;
+	job.linesTotal = (numChars + charsPerLine - 1) / charsPerLine;
+	return _submit(job, priority);
+}
+uint16_t PrintJobQueue::submitPrintwheelSample(uint8_t plusPosition, uint8_t underscorePosition,
+                                              print_job_priority priority) {
+	PrintJob job = {};
+	job.kind = JOB_PRINTWHEEL_SAMPLE;
+	job.parameter1 = plusPosition;
+	job.parameter2 = underscorePosition;
+	job.charsTotal = WW_PRINTWHEEL_SAMPLE_GLYPHS;
+	job.linesTotal = WW_PRINTWHEEL_SAMPLE_LINES;
+	return _submit(job, priority);
+}
+uint16_t PrintJobQueue::_submit(PrintJob& job, print_job_priority priority) {
+	if (full() || (priority >= JOB_PRIORITIES)) {
+		return 0;
+	}
+	job.id = nextId_++;
+	if (!nextId_) {
+		nextId_ = 1;
+	}
+	job.state = JOB_QUEUED;
+	job.priority = priority;
+	job.lineStart = true;
+	jobs_.push_back(job);
+	return job.id;
+}
+
+void PrintJobQueue::service() {
+	uint32_t now = millis();
+	uint32_t interval = now - lastService_;
+	lastService_ = now;
+
+	PrintJob* job = _current();
+	PrintJob* next = _next();
+	bool yielding = job && !job->stopping && (suspended_ || (next && (next->priority > job->priority)));
+	if (yielding && ((job->state == JOB_PAUSED) || job->lineStart)) {
+		_preempt(*job);
+		job = NULL;
+	}
+	if (!job) {
+		if (suspended_ || !next) {
+			return;
+		}
+		job = next;
+		_start(*job);
+		yielding = false;
+		interval = 0;
+	}
+	if (job->state == JOB_PAUSED) {
+		return;
+	}
+	job->elapsed += interval;
+
+	for (uint8_t i = 0; !job->stopping && (i < STEPS_PER_SERVICE) && (typewriter_.pending() < STEP_PENDING_MAX); i++) {
+		if (!_step(*job)) {
+			job->stopping = true;
+			// Nothing more is coming to merge with what has been held back
+			typewriter_.settle();
+		}
+		else if (yielding && job->lineStart) {
+			_preempt(*job);
+			return;
+		}
+	}
+	if (job->stopping) {
+		typewriter_.service();
+		if (!typewriter_.pending()) {
+			_finish(*job);
+		}
+	}
+}
+void PrintJobQueue::suspend() {
+	suspended_ = true;
+	while (_current()) {
+		service();
+		typewriter_.service();
+	}
+	// Back to how the serial interface expects to find it
+	typewriter_.setAsync(false);
+}
+void PrintJobQueue::release() {
+	suspended_ = false;
+}
+PrintJob* PrintJobQueue::_current() {
+	for (PrintJob& job : jobs_) {
+		if ((job.state == JOB_RUNNING) || ((job.state == JOB_PAUSED) && !job.contextSaved)) {
+			return &job;
+		}
+	}
+	return NULL;
+}
+PrintJob* PrintJobQueue::_next() {
+	PrintJob* next = NULL;
+	for (PrintJob& job : jobs_) {
+		if (((job.state == JOB_QUEUED) || (job.state == JOB_PREEMPTED)) && (!next || (job.priority > next->priority))) {
+			next = &job;
+		}
+	}
+	return next;
+}
+void PrintJobQueue::_start(PrintJob& job) {
+	job.state = JOB_RUNNING;
+	if (job.contextSaved) {
+		typewriter_.restoreContext(job.context);
+		job.contextSaved = false;
+		typewriter_.setAsync(true);
+		return;
+	}
+	if (job.kind == JOB_TYPE) {
+		typewriter_.readFlush();
+	}
+	typewriter_.setSpaceForWheel();
+	typewriter_.setLeftMargin();
+	if (job.kind == JOB_TYPE) {
+		typewriter_.setTopOfPage();
+		typewriter_.typeStream.reset();
+		typewriter_.typeStream.setUseCaratAsControl(true);
+	}
+	// Steps return as soon as their commands are queued
+	typewriter_.setAsync(true);
+}
+void PrintJobQueue::_preempt(PrintJob& job) {
+	// What has been held back belongs to this job
+	typewriter_.settle();
+	typewriter_.saveContext(job.context);
+	job.contextSaved = true;
+	if (typewriter_.horizontalMicrospaces()) {
+		// Paused mid-line - leave a fresh line for whatever comes next
+		typewriter_.carriageReturn();
+		typewriter_.lineFeed();
+	}
+	if (job.state == JOB_RUNNING) {
+		job.state = JOB_PREEMPTED;
+	}
+}
+bool PrintJobQueue::_step(PrintJob& job) {
+	if (job.cancelled) {
+		return false;
+	}
+	switch (job.kind) {
+		case JOB_TYPE: {
+			if (job.chars >= job.charsTotal) {
+				return false;
+			}
+			char c = job.text[job.chars++];
+			if ((c == '\n') || (job.chars == job.charsTotal)) {
+				job.lines++;
+			}
+			if (!(typewriter_.typeStream << c)) {
+				// The stream has ended the text
+				job.charsTotal = job.chars;
+				job.linesTotal = job.lines;
+				return false;
+			}
+			// Not inside an escape sequence that happens to contain a newline
+			job.lineStart = (c == '\n') && !typewriter_.typeStream.inSequence();
+			return true;
+		}
+		case JOB_BUFFER_TEST: {
+			if (job.chars >= job.charsTotal) {
+				return false;
+			}
+			typewriter_.bufferTestCharacter(job.chars++, job.charsTotal, job.parameter1);
+			job.lineStart = (job.chars % job.parameter1) == 0;
+			if (job.lineStart || (job.chars == job.charsTotal)) {
+				job.lines++;
+			}
+			return true;
+		}
+		case JOB_PRINTWHEEL_SAMPLE: {
+			if (job.lines >= job.linesTotal) {
+				return false;
+			}
+			job.chars += typewriter_.printwheelSampleLine(job.lines++, job.parameter1, job.parameter2);
+			job.lineStart = true;
+			return true;
+		}
+	}
+	return false;
+}
+void PrintJobQueue::_finish(PrintJob& job) {
+	if (job.kind == JOB_TYPE) {
+		typewriter_.clearRepeatMode();
+	}
+	typewriter_.setAsync(false);
+	job.state = job.cancelled ? JOB_CANCELLED : JOB_DONE;
+	_forget();
+}
+void PrintJobQueue::_forget() {
+	size_t finished = 0;
+	for (const PrintJob& job : jobs_) {
+		if ((job.state == JOB_DONE) || (job.state == JOB_CANCELLED)) {
+			finished++;
+		}
+	}
+	for (auto job = jobs_.begin(); (finished > WW_JOB_HISTORY_MAX) && (job != jobs_.end());) {
+		if ((job->state == JOB_DONE) || (job->state == JOB_CANCELLED)) {
+			job = jobs_.erase(job);
+			finished--;
+		}
+		else {
+			job++;
+		}
+	}
+}
+
+const PrintJob* PrintJobQueue::find(uint16_t id) {
+	return _find(id);
+}
+PrintJob* PrintJobQueue::_find(uint16_t id) {
+	for (PrintJob& job : jobs_) {
+		if (job.id == id) {
+			return &job;
+		}
+	}
+	return NULL;
+}
+bool PrintJobQueue::cancel(uint16_t id) {
+	PrintJob* job = _find(id);
+	if (!job) {
+		return false;
+	}
+	switch (job->state) {
+		case JOB_QUEUED:
+		case JOB_PREEMPTED:
+			job->cancelled = true;
+			job->state = JOB_CANCELLED;
+			_forget();
+			return true;
+		case JOB_PAUSED:
+			if (job->contextSaved) {
+				// Nothing of it is left on the bus
+				job->cancelled = true;
+				job->state = JOB_CANCELLED;
+				_forget();
+				return true;
+			}
+			// Let service() wind it up
+			job->state = JOB_RUNNING;
+			// Fall through
+		case JOB_RUNNING:
+			job->cancelled = true;
+			return true;
+		default:
+			return false;
+	}
+}
+bool PrintJobQueue::pause(uint16_t id) {
+	PrintJob* job = _find(id);
+	if (!job || ((job->state != JOB_RUNNING) && (job->state != JOB_PREEMPTED)) || job->stopping) {
+		return false;
+	}
+	job->state = JOB_PAUSED;
+	return true;
+}
+bool PrintJobQueue::resume(uint16_t id) {
+	PrintJob* job = _find(id);
+	if (!job || (job->state != JOB_PAUSED)) {
+		return false;
+	}
+	// A preempted one waits its turn again
+	job->state = job->contextSaved ? JOB_PREEMPTED : JOB_RUNNING;
+	return true;
+}
+
+uint8_t PrintJobQueue::active() {
+	uint8_t count = 0;
+	for (const PrintJob& job : jobs_) {
+		if ((job.state == JOB_QUEUED) || (job.state == JOB_RUNNING) || (job.state == JOB_PAUSED) ||
+		    (job.state == JOB_PREEMPTED)) {
+			count++;
+		}
+	}
+	return count;
+}
+bool PrintJobQueue::full() {
+	return active() >= WW_JOB_QUEUE_MAX;
+}
+int32_t PrintJobQueue::eta(const PrintJob& job) {
+	if ((job.state == JOB_DONE) || (job.state == JOB_CANCELLED)) {
+		return 0;
+	}
+	// The sample's lines vary too much in length to go by glyphs
+	uint32_t done = (job.kind == JOB_PRINTWHEEL_SAMPLE) ? job.lines : job.chars;
+	uint32_t total = (job.kind == JOB_PRINTWHEEL_SAMPLE) ? job.linesTotal : job.charsTotal;
+	if (!done || !job.elapsed) {
+		return -1;
+	}
+	return (int32_t)((uint64_t)job.elapsed * (total - done) / done / 1000);
+}
+
+void PrintJobQueue::toJson(const PrintJob& job, std::string& json) {
+	int32_t seconds = eta(job);
+	json = "{";
+	json += "\"id\":" + std::to_string(job.id) + ",";
+	json += "\"kind\":\"" + std::string(jobKindNames[job.kind]) + "\",";
+	json += "\"state\":\"" + std::string(jobStateNames[job.state]) + "\",";
+	json += "\"priority\":\"" + std::string(jobPriorityNames[job.priority]) + "\",";
+	json += "\"chars\":" + std::to_string(job.chars) + ",";
+	json += "\"charsTotal\":" + std::to_string(job.charsTotal) + ",";
+	json += "\"lines\":" + std::to_string(job.lines) + ",";
+	json += "\"linesTotal\":" + std::to_string(job.linesTotal) + ",";
+	json += "\"elapsed\":" + std::to_string(job.elapsed / 1000) + ",";
+	json += "\"eta\":" + ((seconds < 0) ? std::string("null") : std::to_string(seconds));
+	json += "}";
+}
+void PrintJobQueue::toJson(std::string& json) {
+	json = "[";
+	for (size_t i = 0; i < jobs_.size(); i++) {
+		std::string jobJson;
+		toJson(jobs_[i], jobJson);
+		if (i) {
+			json += ",";
+		}
+		json += jobJson;
+	}
+	json += "]";
+}
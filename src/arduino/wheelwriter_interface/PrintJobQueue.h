@@ -0,0 +1,147 @@
+// Print jobs, queued by the REST API and typed in the background
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+// A job is typed a step at a time from service(), which the main loop calls
+// between requests: a character of text or of the buffer test, or a line of
+// the printwheel sample. Steps are only taken while the bus queue has room for
+// them, so service() doesn't wait for the typewriter, and the typewriter is
+// kept busy from the queue while requests are being served. A job is done once
+// everything it queued has been struck.
+//
+// Jobs run one at a time, the most urgent first and otherwise in the order
+// they were submitted. A job that something more urgent is waiting behind is
+// preempted at the end of its current line: its position and TypeStream style
+// are saved, and restored when it resumes, so it carries on exactly where it
+// stopped (below whatever was typed in between). A short urgent job therefore
+// waits for at most a line of a long one. A paused job is preempted where it
+// is, and after a line feed if that is mid-line. suspend() does the same for
+// the serial interface. Finished jobs are kept for a while so that their final
+// state can still be read.
+//
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Wheelwriter.h"
+
+namespace wheelwriter {
+
+enum print_job_kind {
+	JOB_TYPE = 0,
+	JOB_BUFFER_TEST,
+	JOB_PRINTWHEEL_SAMPLE
+};
+
+enum print_job_state {
+	JOB_QUEUED = 0,
+	JOB_RUNNING,
+	JOB_PAUSED,
+	JOB_DONE,
+	JOB_CANCELLED,
+	JOB_PREEMPTED    // Waiting to resume
+};
+
+enum print_job_priority {
+	JOB_PRIORITY_BULK = 0,
+	JOB_PRIORITY_NORMAL,
+	JOB_PRIORITY_URGENT,
+	JOB_PRIORITIES
+};
+
+struct PrintJob {
+	uint16_t id;
+	print_job_kind kind;
+	print_job_state state;
+	print_job_priority priority;
+	bool stopping;        // Everything has been queued (or it was cancelled) - waiting for it to be struck
+	bool cancelled;
+	std::string text;     // JOB_TYPE
+	uint16_t parameter1;  // JOB_BUFFER_TEST: characters per line, JOB_PRINTWHEEL_SAMPLE: plus position
+	uint16_t parameter2;  // JOB_PRINTWHEEL_SAMPLE: underscore position
+	uint32_t chars;
+	uint32_t charsTotal;
+	uint16_t lines;
+	uint16_t linesTotal;
+	uint32_t elapsed;     // Milliseconds spent running, not counting pauses
+	bool lineStart;       // The last step ended a line - it can be preempted here
+	bool contextSaved;    // Preempted - context is restored before it types again
+	ww_typing_context context;
+};
+
+// "bulk", "normal" or "urgent". Returns false for anything else.
+bool parseJobPriority(std::string_view name, print_job_priority& priority);
+
+// Jobs waiting or running - further submissions are refused
+static const uint8_t WW_JOB_QUEUE_MAX = 4;
+// Finished jobs kept for their status
+static const uint8_t WW_JOB_HISTORY_MAX = 8;
+
+class PrintJobQueue {
+public:
+	// Steps are taken while fewer transactions than this are queued
+	static const uint8_t STEP_PENDING_MAX = 16;
+	// Most steps taken by one call to service()
+	static const uint8_t STEPS_PER_SERVICE = 8;
+
+	PrintJobQueue(Wheelwriter& typewriter) : typewriter_(typewriter), nextId_(1), lastService_(0), suspended_(false) {}
+
+	// Each queues a job and returns its ID, or 0 if the queue is full
+	uint16_t submitText(const std::string& text, print_job_priority priority=JOB_PRIORITY_NORMAL);
+	uint16_t submitBufferTest(uint16_t numChars, uint8_t charsPerLine, print_job_priority priority=JOB_PRIORITY_NORMAL);
+	uint16_t submitPrintwheelSample(uint8_t plusPosition, uint8_t underscorePosition, 
+	                                print_job_priority priority=JOB_PRIORITY_NORMAL);
+
+	// Starts or resumes the most urgent job, and types as much of it as the bus
+	// queue has room for
+	void service();
+	// Takes the running job to the end of its line and preempts it, then holds
+	// all jobs until release(), so that the caller can use the typewriter. Waits
+	// for at most a line, or for a job that is finishing to be struck.
+	void suspend();
+	void release();
+
+	// Returns NULL if there is no such job, or it has been forgotten
+	const PrintJob* find(uint16_t id);
+	// Each returns false if the job isn't in a state it applies to. A running
+	// job stops at the next step, and is cancelled once what it has already
+	// queued has been struck.
+	bool cancel(uint16_t id);
+	bool pause(uint16_t id);
+	bool resume(uint16_t id);
+
+	// Jobs waiting, running, paused or preempted
+	uint8_t active();
+	bool full();
+	// Seconds until the job is done, from its progress so far, or -1 if that
+	// can't be told yet
+	int32_t eta(const PrintJob& job);
+
+	void toJson(const PrintJob& job, std::string& json);
+	// All the jobs held, oldest first
+	void toJson(std::string& json);
+
+private:
+	uint16_t _submit(PrintJob& job, print_job_priority priority);
+	PrintJob* _find(uint16_t id);
+	// The job holding the typewriter - running, or paused where it stopped - if any
+	PrintJob* _current();
+	// The most urgent of the jobs waiting to start or resume
+	PrintJob* _next();
+	void _start(PrintJob& job);
+	void _preempt(PrintJob& job);
+	// Takes one step. Returns false once there is nothing left to queue.
+	bool _step(PrintJob& job);
+	void _finish(PrintJob& job);
+	void _forget();
+
+	Wheelwriter& typewriter_;
+	std::vector<PrintJob> jobs_;
+	uint16_t nextId_;
+	uint32_t lastService_;
+	bool suspended_;
+};
+
+} // namespace wheelwriter
@@ -0,0 +1,299 @@
+// Printwheel translation tables for each keyboard
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+// Generated by printwheel_tables.py from wheelwriter_printwheel_mapping.tsv -
+// edit the TSV and run the script again rather than editing this file.
+// Keyboards not listed (and the symbol wheels, which have nothing in the TSV
+// yet) use the US tables.
+//
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace wheelwriter {
+
+static constexpr uint8_t WW_PRINTWHEEL_POSITIONS = 0x61;
+static constexpr uint16_t WW_CYRILLIC_FIRST = 0x0400;
+static constexpr uint8_t WW_CYRILLIC_LENGTH = 0x60;
+
+// How hard a glyph wants to be struck, for the impression tables
+enum ww_impression_level : uint8_t {
+	IMPRESSION_LIGHT = 0,
+	IMPRESSION_NORMAL = 1,
+	IMPRESSION_HEAVY = 2,
+	IMPRESSION_LEVELS
+};
+
+// US (001)
+static constexpr uint16_t ww_printwheel_unicode_us[WW_PRINTWHEEL_POSITIONS] = {
+	0x0020, 0x0061, 0x006e, 0x0072, 0x006d, 0x0063, 0x0073, 0x0064, 0x0068, 0x006c, 0x0066, 0x006b, 0x002c, 0x0056, 0x002d, 0x0047,
+	0x0055, 0x0046, 0x0042, 0x005a, 0x0048, 0x0050, 0x0029, 0x0052, 0x004c, 0x0053, 0x004e, 0x0043, 0x0054, 0x0044, 0x0045, 0x0049,
+	0x0041, 0x004a, 0x004f, 0x0028, 0x004d, 0x002e, 0x0059, 0x002c, 0x002f, 0x0057, 0x0039, 0x004b, 0x0033, 0x0058, 0x0031, 0x0032,
+	0x0030, 0x0035, 0x0034, 0x0036, 0x0038, 0x0037, 0x002a, 0x0024, 0x0023, 0x0025, 0x00a2, 0x002b, 0x00b1, 0x0040, 0x0051, 0x0026,
+	0x005d, 0x005b, 0x00b3, 0x00b2, 0x00b0, 0x00a7, 0x00b6, 0x00bd, 0x00bc, 0x0021, 0x003f, 0x0022, 0x0027, 0x003d, 0x003a, 0x005f,
+	0x003b, 0x0078, 0x0071, 0x0076, 0x007a, 0x0077, 0x006a, 0x002e, 0x0079, 0x0062, 0x0067, 0x0075, 0x0070, 0x0069, 0x0074, 0x006f,
+	0x0065
+};
+static constexpr uint8_t ww_latin1_printwheel_us[256] = {
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x49, 0x4b, 0x38, 0x37, 0x39, 0x3f, 0x4c, 0x23, 0x16, 0x36, 0x3b, 0x0c, 0x0e, 0x57, 0x28,
+	0x30, 0x2e, 0x2f, 0x2c, 0x32, 0x31, 0x33, 0x35, 0x34, 0x2a, 0x4e, 0x50, 0x00, 0x4d, 0x00, 0x4a,
+	0x3d, 0x20, 0x12, 0x1b, 0x1d, 0x1e, 0x11, 0x0f, 0x14, 0x1f, 0x21, 0x2b, 0x18, 0x24, 0x1a, 0x22,
+	0x15, 0x3e, 0x17, 0x19, 0x1c, 0x10, 0x0d, 0x29, 0x2d, 0x26, 0x13, 0x41, 0x00, 0x40, 0x00, 0x4f,
+	0x00, 0x01, 0x59, 0x05, 0x07, 0x60, 0x0a, 0x5a, 0x08, 0x5d, 0x56, 0x0b, 0x09, 0x04, 0x02, 0x5f,
+	0x5c, 0x52, 0x03, 0x06, 0x5e, 0x5b, 0x53, 0x55, 0x51, 0x58, 0x54, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x3a, 0x00, 0x00, 0x00, 0x00, 0x45, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x44, 0x3c, 0x43, 0x42, 0x00, 0x00, 0x46, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0x47, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+static constexpr uint8_t ww_printwheel_impression_us[WW_PRINTWHEEL_POSITIONS] = {
+	0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x01, 0x00, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x02, 0x00, 0x01, 0x00, 0x01, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x02, 0x02, 0x01, 0x01, 0x01, 0x02, 0x01, 0x02,
+	0x01, 0x01, 0x01, 0x01, 0x00, 0x02, 0x02, 0x02, 0x02, 0x01, 0x01, 0x01, 0x00, 0x01, 0x00, 0x01,
+	0x00, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x00, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01
+};
+
+// Germany (026, 029)
+static constexpr uint16_t ww_printwheel_unicode_germany[WW_PRINTWHEEL_POSITIONS] = {
+	0x0020, 0x0061, 0x006e, 0x0072, 0x006d, 0x0063, 0x0073, 0x0064, 0x0068, 0x006c, 0x0066, 0x006b, 0x002c, 0x0056, 0x002d, 0x0047,
+	0x0055, 0x0046, 0x0042, 0x005a, 0x0048, 0x0050, 0x0029, 0x0052, 0x004c, 0x0053, 0x004e, 0x0043, 0x0054, 0x0044, 0x0045, 0x0049,
+	0x0041, 0x004a, 0x004f, 0x0028, 0x004d, 0x0060, 0x0059, 0x00b4, 0x002f, 0x0057, 0x0039, 0x004b, 0x0033, 0x0058, 0x0031, 0x0032,
+	0x0030, 0x0035, 0x0034, 0x0036, 0x0038, 0x0037, 0x002a, 0x0024, 0x0023, 0x0025, 0x00fc, 0x002b, 0x00dc, 0x00c4, 0x0051, 0x0026,
+	0x00df, 0x00b5, 0x00b3, 0x00b2, 0x00b0, 0x00a7, 0x00d6, 0x00f6, 0x00e4, 0x0021, 0x003f, 0x0022, 0x0027, 0x003d, 0x003a, 0x005f,
+	0x003b, 0x0078, 0x0071, 0x0076, 0x007a, 0x0077, 0x006a, 0x002e, 0x0079, 0x0062, 0x0067, 0x0075, 0x0070, 0x0069, 0x0074, 0x006f,
+	0x0065
+};
+static constexpr uint8_t ww_latin1_printwheel_germany[256] = {
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x49, 0x4b, 0x38, 0x37, 0x39, 0x3f, 0x4c, 0x23, 0x16, 0x36, 0x3b, 0x0c, 0x0e, 0x57, 0x28,
+	0x30, 0x2e, 0x2f, 0x2c, 0x32, 0x31, 0x33, 0x35, 0x34, 0x2a, 0x4e, 0x50, 0x00, 0x4d, 0x00, 0x4a,
+	0x00, 0x20, 0x12, 0x1b, 0x1d, 0x1e, 0x11, 0x0f, 0x14, 0x1f, 0x21, 0x2b, 0x18, 0x24, 0x1a, 0x22,
+	0x15, 0x3e, 0x17, 0x19, 0x1c, 0x10, 0x0d, 0x29, 0x2d, 0x26, 0x13, 0x00, 0x00, 0x00, 0x00, 0x4f,
+	0x25, 0x01, 0x59, 0x05, 0x07, 0x60, 0x0a, 0x5a, 0x08, 0x5d, 0x56, 0x0b, 0x09, 0x04, 0x02, 0x5f,
+	0x5c, 0x52, 0x03, 0x06, 0x5e, 0x5b, 0x53, 0x55, 0x51, 0x58, 0x54, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x45, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x44, 0x00, 0x43, 0x42, 0x27, 0x41, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x3d, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3c, 0x00, 0x00, 0x40,
+	0x00, 0x00, 0x00, 0x00, 0x48, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x47, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3a, 0x00, 0x00, 0x00
+};
+static constexpr uint8_t ww_printwheel_impression_germany[WW_PRINTWHEEL_POSITIONS] = {
+	0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x01, 0x00, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x02, 0x00, 0x01, 0x00, 0x01, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x02, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x02,
+	0x01, 0x01, 0x01, 0x01, 0x00, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x01, 0x00, 0x01,
+	0x00, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x00, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01
+};
+
+// UK (067, 253)
+static constexpr uint16_t ww_printwheel_unicode_uk[WW_PRINTWHEEL_POSITIONS] = {
+	0x0020, 0x0061, 0x006e, 0x0072, 0x006d, 0x0063, 0x0073, 0x0064, 0x0068, 0x006c, 0x0066, 0x006b, 0x002c, 0x0056, 0x002d, 0x0047,
+	0x0055, 0x0046, 0x0042, 0x005a, 0x0048, 0x0050, 0x0029, 0x0052, 0x004c, 0x0053, 0x004e, 0x0043, 0x0054, 0x0044, 0x0045, 0x0049,
+	0x0041, 0x004a, 0x004f, 0x0028, 0x004d, 0x002e, 0x0059, 0x002c, 0x002f, 0x0057, 0x0039, 0x004b, 0x0033, 0x0058, 0x0031, 0x0032,
+	0x0030, 0x0035, 0x0034, 0x0036, 0x0038, 0x0037, 0x002a, 0x0024, 0x0023, 0x0025, 0x00b5, 0x002b, 0x00b1, 0x0040, 0x0051, 0x0026,
+	0x005d, 0x005b, 0x00b3, 0x00b2, 0x00b0, 0x003c, 0x00a3, 0x00bd, 0x003e, 0x0021, 0x003f, 0x0022, 0x0027, 0x003d, 0x003a, 0x005f,
+	0x003b, 0x0078, 0x0071, 0x0076, 0x007a, 0x0077, 0x006a, 0x002e, 0x0079, 0x0062, 0x0067, 0x0075, 0x0070, 0x0069, 0x0074, 0x006f,
+	0x0065
+};
+static constexpr uint8_t ww_latin1_printwheel_uk[256] = {
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x49, 0x4b, 0x38, 0x37, 0x39, 0x3f, 0x4c, 0x23, 0x16, 0x36, 0x3b, 0x0c, 0x0e, 0x57, 0x28,
+	0x30, 0x2e, 0x2f, 0x2c, 0x32, 0x31, 0x33, 0x35, 0x34, 0x2a, 0x4e, 0x50, 0x45, 0x4d, 0x48, 0x4a,
+	0x3d, 0x20, 0x12, 0x1b, 0x1d, 0x1e, 0x11, 0x0f, 0x14, 0x1f, 0x21, 0x2b, 0x18, 0x24, 0x1a, 0x22,
+	0x15, 0x3e, 0x17, 0x19, 0x1c, 0x10, 0x0d, 0x29, 0x2d, 0x26, 0x13, 0x41, 0x00, 0x40, 0x00, 0x4f,
+	0x00, 0x01, 0x59, 0x05, 0x07, 0x60, 0x0a, 0x5a, 0x08, 0x5d, 0x56, 0x0b, 0x09, 0x04, 0x02, 0x5f,
+	0x5c, 0x52, 0x03, 0x06, 0x5e, 0x5b, 0x53, 0x55, 0x51, 0x58, 0x54, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x46, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x44, 0x3c, 0x43, 0x42, 0x00, 0x3a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x47, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+static constexpr uint8_t ww_printwheel_impression_uk[WW_PRINTWHEEL_POSITIONS] = {
+	0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x01, 0x00, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x02, 0x00, 0x01, 0x00, 0x01, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x02, 0x02, 0x01, 0x01, 0x01, 0x02, 0x01, 0x02,
+	0x01, 0x01, 0x01, 0x01, 0x00, 0x01, 0x01, 0x02, 0x01, 0x01, 0x01, 0x01, 0x00, 0x01, 0x00, 0x01,
+	0x00, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x00, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01
+};
+
+// Spain (070)
+static constexpr uint16_t ww_printwheel_unicode_spain[WW_PRINTWHEEL_POSITIONS] = {
+	0x0020, 0x0061, 0x006e, 0x0072, 0x006d, 0x0063, 0x0073, 0x0064, 0x0068, 0x006c, 0x0066, 0x006b, 0x002c, 0x0056, 0x002d, 0x0047,
+	0x0055, 0x0046, 0x0042, 0x005a, 0x0048, 0x0050, 0x0029, 0x0052, 0x004c, 0x0053, 0x004e, 0x0043, 0x0054, 0x0044, 0x0045, 0x0049,
+	0x0041, 0x004a, 0x004f, 0x0028, 0x004d, 0x0060, 0x0059, 0x00b4, 0x002f, 0x0057, 0x0039, 0x004b, 0x0033, 0x0058, 0x0031, 0x0032,
+	0x0030, 0x0035, 0x0034, 0x0036, 0x0038, 0x0037, 0x002a, 0x0024, 0x00d1, 0x0025, 0x00bf, 0x002b, 0x00a8, 0x00b7, 0x0051, 0x0026,
+	0x00a1, 0x00ba, 0x00c7, 0x00e7, 0x00aa, 0x003c, 0x003e, 0x00f1, 0x0302, 0x0021, 0x003f, 0x0022, 0x0027, 0x003d, 0x003a, 0x005f,
+	0x003b, 0x0078, 0x0071, 0x0076, 0x007a, 0x0077, 0x006a, 0x002e, 0x0079, 0x0062, 0x0067, 0x0075, 0x0070, 0x0069, 0x0074, 0x006f,
+	0x0065
+};
+static constexpr uint8_t ww_latin1_printwheel_spain[256] = {
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x49, 0x4b, 0x00, 0x37, 0x39, 0x3f, 0x4c, 0x23, 0x16, 0x36, 0x3b, 0x0c, 0x0e, 0x57, 0x28,
+	0x30, 0x2e, 0x2f, 0x2c, 0x32, 0x31, 0x33, 0x35, 0x34, 0x2a, 0x4e, 0x50, 0x45, 0x4d, 0x46, 0x4a,
+	0x00, 0x20, 0x12, 0x1b, 0x1d, 0x1e, 0x11, 0x0f, 0x14, 0x1f, 0x21, 0x2b, 0x18, 0x24, 0x1a, 0x22,
+	0x15, 0x3e, 0x17, 0x19, 0x1c, 0x10, 0x0d, 0x29, 0x2d, 0x26, 0x13, 0x00, 0x00, 0x00, 0x00, 0x4f,
+	0x25, 0x01, 0x59, 0x05, 0x07, 0x60, 0x0a, 0x5a, 0x08, 0x5d, 0x56, 0x0b, 0x09, 0x04, 0x02, 0x5f,
+	0x5c, 0x52, 0x03, 0x06, 0x5e, 0x5b, 0x53, 0x55, 0x51, 0x58, 0x54, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3c, 0x00, 0x44, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x27, 0x00, 0x00, 0x3d, 0x00, 0x00, 0x41, 0x00, 0x00, 0x00, 0x00, 0x3a,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x42, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x38, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x43, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x47, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+static constexpr uint8_t ww_printwheel_impression_spain[WW_PRINTWHEEL_POSITIONS] = {
+	0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x01, 0x00, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x02, 0x00, 0x01, 0x00, 0x01, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01, 0x00, 0x00, 0x01, 0x02,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x01, 0x00, 0x01,
+	0x00, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x00, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01
+};
+
+// ASCII (103)
+static constexpr uint16_t ww_printwheel_unicode_ascii[WW_PRINTWHEEL_POSITIONS] = {
+	0x0020, 0x0061, 0x006e, 0x0072, 0x006d, 0x0063, 0x0073, 0x0064, 0x0068, 0x006c, 0x0066, 0x006b, 0x002c, 0x0056, 0x002d, 0x0047,
+	0x0055, 0x0046, 0x0042, 0x005a, 0x0048, 0x0050, 0x0029, 0x0052, 0x004c, 0x0053, 0x004e, 0x0043, 0x0054, 0x0044, 0x0045, 0x0049,
+	0x0041, 0x004a, 0x004f, 0x0028, 0x004d, 0x002e, 0x0059, 0x002c, 0x002f, 0x0057, 0x0039, 0x004b, 0x0033, 0x0058, 0x0031, 0x0032,
+	0x0030, 0x0035, 0x0034, 0x0036, 0x0038, 0x0037, 0x002a, 0x0024, 0x0023, 0x0025, 0x005e, 0x002b, 0x0060, 0x0040, 0x0051, 0x0026,
+	0x005d, 0x005b, 0x005c, 0x007c, 0x007e, 0x003c, 0x003e, 0x007d, 0x007b, 0x0021, 0x003f, 0x0022, 0x0027, 0x003d, 0x003a, 0x005f,
+	0x003b, 0x0078, 0x0071, 0x0076, 0x007a, 0x0077, 0x006a, 0x002e, 0x0079, 0x0062, 0x0067, 0x0075, 0x0070, 0x0069, 0x0074, 0x006f,
+	0x0065
+};
+static constexpr uint8_t ww_latin1_printwheel_ascii[256] = {
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x49, 0x4b, 0x38, 0x37, 0x39, 0x3f, 0x4c, 0x23, 0x16, 0x36, 0x3b, 0x0c, 0x0e, 0x57, 0x28,
+	0x30, 0x2e, 0x2f, 0x2c, 0x32, 0x31, 0x33, 0x35, 0x34, 0x2a, 0x4e, 0x50, 0x45, 0x4d, 0x46, 0x4a,
+	0x3d, 0x20, 0x12, 0x1b, 0x1d, 0x1e, 0x11, 0x0f, 0x14, 0x1f, 0x21, 0x2b, 0x18, 0x24, 0x1a, 0x22,
+	0x15, 0x3e, 0x17, 0x19, 0x1c, 0x10, 0x0d, 0x29, 0x2d, 0x26, 0x13, 0x41, 0x42, 0x40, 0x3a, 0x4f,
+	0x3c, 0x01, 0x59, 0x05, 0x07, 0x60, 0x0a, 0x5a, 0x08, 0x5d, 0x56, 0x0b, 0x09, 0x04, 0x02, 0x5f,
+	0x5c, 0x52, 0x03, 0x06, 0x5e, 0x5b, 0x53, 0x55, 0x51, 0x58, 0x54, 0x48, 0x43, 0x47, 0x44, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+static constexpr uint8_t ww_printwheel_impression_ascii[WW_PRINTWHEEL_POSITIONS] = {
+	0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x01, 0x00, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x02, 0x00, 0x01, 0x00, 0x01, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x02, 0x02, 0x01, 0x01, 0x00, 0x02, 0x01, 0x02,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x01, 0x00, 0x01,
+	0x00, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x00, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01
+};
+
+// USSR (231)
+static constexpr uint16_t ww_printwheel_unicode_ussr[WW_PRINTWHEEL_POSITIONS] = {
+	0x0020, 0x0430, 0x043d, 0x0440, 0x043c, 0x0446, 0x0441, 0x0434, 0x0445, 0x043b, 0x0444, 0x043a, 0x002c, 0x0412, 0x002d, 0x0413,
+	0x0423, 0x0424, 0x0411, 0x0417, 0x0425, 0x041f, 0x0029, 0x0420, 0x041b, 0x0421, 0x041d, 0x0426, 0x0422, 0x0414, 0x0415, 0x0418,
+	0x0410, 0x0419, 0x041e, 0x0028, 0x041c, 0x0427, 0x042b, 0x042d, 0x002f, 0x0416, 0x0039, 0x041a, 0x0033, 0x042c, 0x0031, 0x0032,
+	0x0030, 0x0035, 0x0034, 0x0036, 0x0038, 0x0037, 0x042e, 0x00a4, 0x044d, 0x0025, 0x044e, 0x002b, 0x0449, 0x0401, 0x042f, 0x0026,
+	0x044a, 0x042a, 0x00b3, 0x00b2, 0x0429, 0x00a7, 0x0447, 0x0448, 0x0428, 0x0021, 0x003f, 0x0022, 0x2116, 0x003d, 0x003a, 0x005f,
+	0x0451, 0x044c, 0x044f, 0x0432, 0x0437, 0x0436, 0x0439, 0x002e, 0x044b, 0x0431, 0x0433, 0x0443, 0x043f, 0x0438, 0x0442, 0x043e,
+	0x0435
+};
+static constexpr uint8_t ww_latin1_printwheel_ussr[256] = {
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x49, 0x4b, 0x00, 0x00, 0x39, 0x3f, 0x00, 0x23, 0x16, 0x00, 0x3b, 0x0c, 0x0e, 0x57, 0x28,
+	0x30, 0x2e, 0x2f, 0x2c, 0x32, 0x31, 0x33, 0x35, 0x34, 0x2a, 0x4e, 0x00, 0x00, 0x4d, 0x00, 0x4a,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x4f,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x37, 0x00, 0x00, 0x45, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x43, 0x42, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+static constexpr uint8_t ww_cyrillic_printwheel_ussr[WW_CYRILLIC_LENGTH] = {
+	0x00, 0x3d, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x20, 0x12, 0x0d, 0x0f, 0x1d, 0x1e, 0x29, 0x13, 0x1f, 0x21, 0x2b, 0x18, 0x24, 0x1a, 0x22, 0x15,
+	0x17, 0x19, 0x1c, 0x10, 0x11, 0x14, 0x1b, 0x25, 0x48, 0x44, 0x41, 0x26, 0x2d, 0x27, 0x36, 0x3e,
+	0x01, 0x59, 0x53, 0x5a, 0x07, 0x60, 0x55, 0x54, 0x5d, 0x56, 0x0b, 0x09, 0x04, 0x02, 0x5f, 0x5c,
+	0x03, 0x06, 0x5e, 0x5b, 0x0a, 0x08, 0x05, 0x46, 0x47, 0x3c, 0x40, 0x58, 0x51, 0x38, 0x3a, 0x52,
+	0x00, 0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+static constexpr uint8_t ww_printwheel_impression_ussr[WW_PRINTWHEEL_POSITIONS] = {
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x01, 0x00, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01, 0x02, 0x02, 0x01, 0x02, 0x01, 0x01, 0x02,
+	0x01, 0x01, 0x01, 0x01, 0x02, 0x02, 0x01, 0x02, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x01,
+	0x01, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x00, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+	0x01
+};
+
+struct ww_printwheel_tables {
+	const uint16_t* toUnicode;     // Printwheel position to Unicode
+	const uint8_t* fromLatin1;     // ISO 8859-1 to printwheel position
+	const uint8_t* fromCyrillic;   // U+0400-U+045F to printwheel position, or NULL
+	const uint8_t* impression;     // Printwheel position to ww_impression_level
+};
+static constexpr ww_printwheel_tables ww_keyboard_tables[] = {
+	{ww_printwheel_unicode_us, ww_latin1_printwheel_us, NULL, ww_printwheel_impression_us},  // US
+	{ww_printwheel_unicode_germany, ww_latin1_printwheel_germany, NULL, ww_printwheel_impression_germany},  // Germany
+	{ww_printwheel_unicode_uk, ww_latin1_printwheel_uk, NULL, ww_printwheel_impression_uk},  // UK
+	{ww_printwheel_unicode_spain, ww_latin1_printwheel_spain, NULL, ww_printwheel_impression_spain},  // Spain
+	{ww_printwheel_unicode_ascii, ww_latin1_printwheel_ascii, NULL, ww_printwheel_impression_ascii},  // ASCII
+	{ww_printwheel_unicode_ussr, ww_latin1_printwheel_ussr, ww_cyrillic_printwheel_ussr, ww_printwheel_impression_ussr}  // USSR
+};
+// Keyboard number to ww_keyboard_tables entry
+static constexpr uint8_t ww_keyboard_table_index[256] = {
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00
+};
+
+} // namespace wheelwriter
@@ -0,0 +1,93 @@
+// Predicts when the Wheelwriter mechanism will be ready
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+#include "ReadinessModel.h"
+#include "Wheelwriter.h"
+
+using namespace wheelwriter;
+
+bool ReadinessModel::uncertain(uint32_t now) {
+	if (!synced_) {
+		return true;
+	}
+	int32_t untilIdle = (int32_t)(idleTime() - now);
+	return (untilIdle < (int32_t)timing_.margin) && (untilIdle > -(int32_t)timing_.margin);
+}
+void ReadinessModel::synced(uint32_t now) {
+	synced_ = true;
+	wheelFree_ = now;
+	carriageFree_ = now;
+	platenFree_ = now;
+}
+void ReadinessModel::lost() {
+	synced_ = false;
+}
+void ReadinessModel::accepted(uint8_t command, uint8_t data1, uint8_t data2, uint32_t now) {
+	switch (command) {
+		case TYPE_CHARACTER_NO_ADVANCE:
+		case TYPE_CHARACTER_AND_ADVANCE:
+		case ERASE_CHARACTER_AND_ADVANCE: {
+			uint8_t advance = (command == TYPE_CHARACTER_NO_ADVANCE) ? 0 : data2;
+			uint32_t end = now;
+			// Position 0 is a space - just the advance
+			if (data1) {
+				end = strike(data1, now, (command == ERASE_CHARACTER_AND_ADVANCE) ? timing_.erase : 0);
+			}
+			if ((repeatMode_ & UNDERLINE) && (command != ERASE_CHARACTER_AND_ADVANCE)) {
+				end = strike(WW_UNDERSCORE_POSITION, now, 0);
+			}
+			if (advance) {
+				carriageFree_ = later(end, carriageFree_) + timing_.carriageBase + (uint32_t)advance * timing_.carriagePerUstep;
+			}
+			break;
+		}
+		case MOVE_CARRIAGE: {
+			uint16_t usteps = ((data1 & 0x07) << 8) | data2;
+			if (usteps) {
+				uint32_t start = later(now, later(carriageFree_, wheelFree_));
+				carriageFree_ = start + timing_.carriageBase + (uint32_t)usteps * timing_.carriagePerUstep;
+			}
+			break;
+		}
+		case MOVE_PLATEN: {
+			uint8_t usteps = data1 & 0x7f;
+			if (usteps) {
+				uint32_t start = later(now, later(platenFree_, wheelFree_));
+				platenFree_ = start + timing_.platenBase + (uint32_t)usteps * timing_.platenPerUstep;
+			}
+			break;
+		}
+		case SET_REPEAT_MODE:
+			repeatMode_ = data1;
+			break;
+		case SPIN_WHEEL:
+			wheelFree_ = later(now, wheelFree_) + timing_.spinWheel;
+			wheelPosition_ = 0;
+			break;
+		case RESET:
+			// The reply comes back with the carriage home, but the wheel may still be moving
+			wheelPosition_ = 0;
+			repeatMode_ = REPEAT_OFF;
+			lost();
+			break;
+		default:
+			break;
+	}
+}
+uint32_t ReadinessModel::strike(uint8_t position, uint32_t now, uint32_t extra) {
+	uint8_t distance = (position + WW_PRINTWHEEL_MAX - wheelPosition_) % WW_PRINTWHEEL_MAX;
+	if (distance > WW_PRINTWHEEL_MAX / 2) {
+		distance = WW_PRINTWHEEL_MAX - distance;
+	}
+	// The wheel turns while the carriage and platen finish, the hammer waits for them
+	uint32_t start = later(now, wheelFree_);
+	uint32_t strikeTime = later(start + (uint32_t)distance * timing_.wheelPerPosition,
+	                            later(carriageFree_, platenFree_));
+	wheelFree_ = strikeTime + timing_.hammer + extra;
+	wheelPosition_ = position;
+	return wheelFree_;
+}
+uint32_t ReadinessModel::idleTime() {
+	return later(wheelFree_, later(carriageFree_, platenFree_));
+}
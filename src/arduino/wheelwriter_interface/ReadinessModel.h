@@ -0,0 +1,72 @@
+// Predicts when the Wheelwriter mechanism will be ready
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+// Follows each command the motor controller accepts and estimates when the
+// wheel/hammer, carriage and platen will finish, from a per-model timing
+// table. The bus transaction engine only queries the status before a command
+// when the prediction can't tell whether the mechanism is still moving: until
+// the status has first been seen idle, after anything the model can't follow
+// (a reset, a failed command), and within a margin of the predicted end of
+// motion. Well before that the controller is certainly busy and holds the ACK
+// until it can take the command, well after it is certainly idle.
+//
+#pragma once
+
+#include <stdint.h>
+
+namespace wheelwriter {
+
+// Mechanism timings, in microseconds
+struct ww_timing {
+	uint8_t model;
+	uint16_t wheelPerPosition;  // Wheel rotation, either way round
+	uint16_t hammer;            // Strike and hammer return
+	uint16_t erase;             // Extra time for an erase strike
+	uint16_t carriageBase;      // Carriage move - start and stop
+	uint16_t carriagePerUstep;
+	uint16_t platenBase;        // Platen move - start and stop
+	uint16_t platenPerUstep;
+	uint32_t spinWheel;         // Wheel spin/home
+	uint16_t margin;            // How far the prediction is trusted either side of the end of motion
+};
+
+class ReadinessModel {
+public:
+	ReadinessModel() : synced_(false), wheelFree_(0), carriageFree_(0), platenFree_(0), wheelPosition_(0), 
+	                   repeatMode_(0) {}
+	void setTiming(const ww_timing& timing) {
+		timing_ = timing;
+	}
+	const ww_timing& timing() const {
+		return timing_;
+	}
+
+	// Whether the status needs checking before sending a command at now (micros())
+	bool uncertain(uint32_t now);
+	// The status came back 0 - everything is idle at now
+	void synced(uint32_t now);
+	// Something happened that the model can't follow
+	void lost();
+	// The motor controller accepted a command at now
+	void accepted(uint8_t command, uint8_t data1, uint8_t data2, uint32_t now);
+	// Predicted time the whole mechanism is idle
+	uint32_t idleTime();
+
+private:
+	static uint32_t later(uint32_t a, uint32_t b) {
+		return ((int32_t)(a - b) > 0) ? a : b;
+	}
+	// Predicts a strike, plus extra time for the hammer. Returns when the wheel is free.
+	uint32_t strike(uint8_t position, uint32_t now, uint32_t extra);
+
+	ww_timing timing_;
+	bool synced_;
+	uint32_t wheelFree_;     // Wheel and hammer
+	uint32_t carriageFree_;
+	uint32_t platenFree_;
+	uint8_t wheelPosition_;
+	uint8_t repeatMode_;
+};
+
+} // namespace wheelwriter
@@ -0,0 +1,55 @@
+// Lock-free single-producer/single-consumer queue
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+// For passing items between the two RP2040 cores without locks: one side only
+// ever pushes and the other only ever pops. Each index is written by one side
+// only, and published after the item it covers, so nothing needs more than
+// the plain loads and stores the Cortex-M0+ can do atomically.
+//
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+namespace wheelwriter {
+
+template <typename T, uint16_t SIZE>
+class SpscQueue {
+	static_assert((SIZE & (SIZE - 1)) == 0, "SpscQueue size must be a power of two");
+
+public:
+	SpscQueue() : head_(0), tail_(0) {}
+
+	// Producer side. Returns false if the queue is full.
+	bool push(const T& item) {
+		uint16_t tail = tail_.load(std::memory_order_relaxed);
+		if ((uint16_t)(tail - head_.load(std::memory_order_acquire)) >= SIZE) {
+			return false;
+		}
+		items_[tail % SIZE] = item;
+		tail_.store((uint16_t)(tail + 1), std::memory_order_release);
+		return true;
+	}
+	// Consumer side. Returns false if the queue is empty.
+	bool pop(T& item) {
+		uint16_t head = head_.load(std::memory_order_relaxed);
+		if (head == tail_.load(std::memory_order_acquire)) {
+			return false;
+		}
+		item = items_[head % SIZE];
+		head_.store((uint16_t)(head + 1), std::memory_order_release);
+		return true;
+	}
+	// Either side, though only the consumer can rely on the answer
+	bool empty() {
+		return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+	}
+
+private:
+	T items_[SIZE];
+	std::atomic<uint16_t> head_;  // Written by the consumer
+	std::atomic<uint16_t> tail_;  // Written by the producer
+};
+
+} // namespace wheelwriter
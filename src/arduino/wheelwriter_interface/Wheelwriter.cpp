@@ -4,29 +4,50 @@
 // Copyright (c) 2023 John Kua <john@kua.fm>
 //
 #include "Wheelwriter.h"
+#include "PageBuffer.h"
 #include <Arduino.h>
+#include <algorithm>
 
 using namespace wheelwriter;
 
 uint8_t Wheelwriter::sendCommand(ww_command command) {
-	uint8_t error, failIndex;
-	uint8_t response = sendCommand(defaultAddress_, command, 0, 0, error, failIndex, 0);
-	if (error) {
-		_printCommandError(error, failIndex, response);
-		return 0;
-	}
-	return (uint8_t)response;
+	return _sendCommandDefault(command, 0, 0);
 }
 uint8_t Wheelwriter::sendCommand(ww_command command, uint8_t data) {
-	uint8_t error, failIndex;
-	uint8_t response = sendCommand(defaultAddress_, command, data, 0, error, failIndex, 0);
-	if (error) {
-		_printCommandError(error, failIndex, response);
-		return 0;
-	}
-	return (uint8_t)response;
+	return _sendCommandDefault(command, data, 0);
 }
 uint8_t Wheelwriter::sendCommand(ww_command command, uint8_t data1, uint8_t data2) {
+	return _sendCommandDefault(command, data1, data2);
+}
+uint8_t Wheelwriter::_sendCommandDefault(ww_command command, uint8_t data1, uint8_t data2) {
+	// Deferred motion goes first, so commands reach the typewriter in order
+	settle();
+	return _sendCommandNow(command, data1, data2);
+}
+uint8_t Wheelwriter::_sendCommandNow(ww_command command, uint8_t data1, uint8_t data2) {
+	if ((command == TYPE_CHARACTER_NO_ADVANCE) || (command == TYPE_CHARACTER_AND_ADVANCE)) {
+		uint8_t impression = _impression(data1);
+		if (impression != (repeatMode_ & WW_IMPRESSION_MASK)) {
+			_sendCommandNow(SET_REPEAT_MODE, (repeatMode_ & ~WW_IMPRESSION_MASK) | impression, 0);
+		}
+	}
+	if (command == SET_REPEAT_MODE) {
+		repeatMode_ = data1;
+	}
+	if ((command == TYPE_CHARACTER_NO_ADVANCE) || (command == TYPE_CHARACTER_AND_ADVANCE) || 
+	    (command == ERASE_CHARACTER_AND_ADVANCE)) {
+		strikes_++;
+		wheelPosition_ = ((repeatMode_ & UNDERLINE) && (command != ERASE_CHARACTER_AND_ADVANCE)) ? 
+		                 WW_UNDERSCORE_POSITION : data1;
+	}
+	else if ((command == RESET) || (command == SPIN_WHEEL)) {
+		wheelPosition_ = 0;
+	}
+	if (async_ && !ww_command_is_query(command)) {
+		// Errors are reported by the callback
+		sendCommandAsync(defaultAddress_, command, data1, data2, 0, _asyncCommandCallback, this);
+		return 0;
+	}
 	uint8_t error, failIndex;
 	uint8_t response = sendCommand(defaultAddress_, command, data1, data2, error, failIndex, 0);
 	if (error) {
@@ -35,189 +56,486 @@ uint8_t Wheelwriter::sendCommand(ww_command command, uint8_t data1, uint8_t data
 	}
 	return (uint8_t)response;
 }
+void Wheelwriter::_asyncCommandCallback(const BusTransaction& transaction, void* context) {
+	if (transaction.error) {
+		((Wheelwriter*)context)->_printCommandError(transaction.error, transaction.failIndex, transaction.response);
+	}
+}
 inline void Wheelwriter::_printCommandError(uint8_t error, uint8_t failIndex, uint16_t response) {
 	switch (error) {
 		case 0x11:
+			if (response == BusTransactionEngine::NO_REPLY) {
+				Serial.write("ERROR: sendCommand(): timeout waiting for ACK to ");
+				Serial.write(ww_command_part_strings[failIndex]);
+				Serial.write(" byte!\n");
+				break;
+			}
 			Serial.write("ERROR: sendCommand(): receive bad ACK to ");
 			Serial.write(ww_command_part_strings[failIndex]);
 			Serial.write(" byte! 0x");
 			Serial.println(response, HEX);
+			break;
 		case 0x13:
 			Serial.write("ERROR: sendCommand(): invalid command! 0x");
 			Serial.println(response, HEX);
 	}
 }
-inline uint16_t Wheelwriter::_sendByte(uint16_t byte) {
-	uart_->write(byte);
-	uart_->read(); // Ignore self-transmission
-	return uart_->read();
-}
 uint16_t Wheelwriter::sendCommand(uint8_t address, uint8_t command, uint8_t data1, uint8_t data2, uint8_t& error, uint8_t& failIndex, int ignoreErrors) {
-	// Ensure the typewriter is ready
-	waitReady((ww_command)command);
-	
-	return _sendCommand(address, command, data1, data2, error, failIndex, ignoreErrors);
+	// Ensure the typewriter is ready - the status is queried ahead of the command
+	// if the readiness model can't tell
+	uint8_t flags = TRANSACTION_QUERY_STATUS;
+	if (ignoreErrors) {
+		flags |= TRANSACTION_IGNORE_ERRORS;
+	}
+	BusTransaction transaction = engine_.wait(_submit(address, command, data1, data2, flags, NULL, NULL));
+	error = transaction.error;
+	failIndex = transaction.failIndex;
+	return transaction.response;
 }
 uint16_t Wheelwriter::_sendCommand(uint8_t address, uint8_t command, uint8_t data1, uint8_t data2, uint8_t& error, uint8_t& failIndex, int ignoreErrors) {
-	error = 0;
-	failIndex = 0;
-
-	// Check if command is valid
-	if (command > WW_MAX_VALID_COMMAND) {
-		error = 0x13;
-		return command;
+	uint8_t flags = ignoreErrors ? TRANSACTION_IGNORE_ERRORS : 0;
+	BusTransaction transaction = engine_.wait(_submit(address, command, data1, data2, flags, NULL, NULL));
+	error = transaction.error;
+	failIndex = transaction.failIndex;
+	return transaction.response;
+}
+uint16_t Wheelwriter::sendCommandAsync(uint8_t address, uint8_t command, uint8_t data1, uint8_t data2, int ignoreErrors,
+                                       BusTransactionCallback callback, void* context, bool haltOnError,
+                                       uint16_t timeout) {
+	uint8_t flags = TRANSACTION_QUERY_STATUS;
+	if (ignoreErrors) {
+		flags |= TRANSACTION_IGNORE_ERRORS;
 	}
-	uint8_t commandLength = ww_command_length[command];
-
-	uint16_t addressOut = address + WW_ADDRESS_BIT;
-	uint16_t response;
-	
-	// Send address
-	response = _sendByte(addressOut);
-	if (!ignoreErrors && (response != 0)) { // Bad ACK
-		error = 0x11;
-		failIndex = 0;
-		return response;
+	if (haltOnError) {
+		flags |= TRANSACTION_HALT_ON_ERROR;
 	}
-
-	// Send command
-	response = _sendByte(command);
-	if (commandLength == 1) {
-		return response;
+	return _submit(address, command, data1, data2, flags, callback, context, timeout);
+}
+uint16_t Wheelwriter::_submit(uint8_t address, uint8_t command, uint8_t data1, uint8_t data2, uint8_t flags,
+                              BusTransactionCallback callback, void* context, uint16_t timeout) {
+	// Backpressure - wait for a free slot
+	while (engine_.full()) {
+		engine_.service();
 	}
-	if (!ignoreErrors && (response != 0)) { // Bad ACK
-		error = 0x11;
-		failIndex = 1;
-		return response;
+	return engine_.submit(address, command, data1, data2, flags, callback, context, timeout);
+}
+uint16_t Wheelwriter::getCommandTimeout(uint8_t command) {
+	return engine_.getCommandTimeout(command);
+}
+void Wheelwriter::setCommandTimeout(uint8_t command, uint16_t timeout) {
+	engine_.setCommandTimeout(command, timeout);
+}
+void Wheelwriter::setAsync(bool async) {
+	if (!async) {
+		flush();
 	}
-
-	// Send data 1
-	response = _sendByte(data1);
-	if (commandLength == 2) {
-		return response;
+	async_ = async;
+}
+bool Wheelwriter::async() {
+	return async_;
+}
+void Wheelwriter::setBusCore(BusCore* core) {
+	flush();
+	if (core) {
+		core->init(uart_, ww_command_length, ww_command_timeout, WW_MAX_VALID_COMMAND, QUERY_STATUS);
+		core->setReadiness(&readiness_);
 	}
-	if (!ignoreErrors && (response != 0)) { // Bad ACK
-		error = 0x11;
-		failIndex = 2;
-		return response;
+	engine_.setBusCore(core);
+	busCore_ = core;
+}
+void Wheelwriter::service() {
+	engine_.service();
+	// Nothing more has come along to merge with - send what's been held back
+	if ((millis() - motionTime_) >= WW_SETTLE_DELAY) {
+		settle();
 	}
-
-	// Send data 2
-	return _sendByte(data2);
 }
-
-uint8_t Wheelwriter::readCommand(uint8_t blocking, uint8_t verbose) {
-	uint16_t response;
-
-	// Address
-	if ((blocking == 0) && (!uart_->available())) {
-		return 0;
+void Wheelwriter::flush() {
+	settle();
+	engine_.flush();
+}
+uint8_t Wheelwriter::pending() {
+	return engine_.pending();
+}
+void Wheelwriter::settle() {
+	if (!lineBuffer_.empty()) {
+		_printLine();
 	}
-	unsigned long startTime = millis();
-	bufferIn_[0] = uart_->read();
-	
-	if (bufferIn_[0] != 0x121) {
-		if (verbose == 2) {
-			sprintf(stringBuffer, "\nERROR: readCommand(): expected address byte = 0x121! Got 0x%03x\n", bufferIn_[0]);
-			Serial.write(stringBuffer);
+	if (pendingCharacter_) {
+		// The move to the right that follows goes in the advance field, as far as it will fit
+		int16_t usteps = horizontalMicrospaces_ - carriageMicrospaces_;
+		uint8_t advance = 0;
+		if (usteps > 0) {
+			advance = (usteps > WW_CARRIAGE_ADVANCE_USTEP_MAX) ? WW_CARRIAGE_ADVANCE_USTEP_MAX : usteps;
 		}
-		return 0;
+		uint8_t wheelPosition = pendingCharacter_;
+		pendingCharacter_ = 0;
+		if (advance) {
+			_sendCommandNow(TYPE_CHARACTER_AND_ADVANCE, wheelPosition, advance);
+		}
+		else {
+			_sendCommandNow(TYPE_CHARACTER_NO_ADVANCE, wheelPosition, 0);
+		}
+		carriageMicrospaces_ += advance;
 	}
-	if (verbose) {
-		sprintf(stringBuffer, "[%d] ADR 0x%03x", startTime, bufferIn_[0]);
-		Serial.write(stringBuffer);
+	if (!pendingErases_.empty()) {
+		_sendErases();
 	}
-
-	// Address ACK
-	response = uart_->read();
-	if (response != 0) {
-		if (verbose == 2) {
-			sprintf(stringBuffer, "\nERROR: readCommand(): expected address ACK = 0! Got 0x%02x\n", response);
-			Serial.write(stringBuffer);
+	// In bidirectional mode the carriage stays where the last line ended
+	if (!bidirectional_) {
+		_moveCarriageTo(horizontalMicrospaces_);
+	}
+	_movePlatenPending();
+}
+void Wheelwriter::setBidirectional(bool bidirectional) {
+	settle();
+	bidirectional_ = bidirectional;
+}
+bool Wheelwriter::bidirectional() {
+	return bidirectional_;
+}
+void Wheelwriter::setStrikeOrdering(bool ordered) {
+	settle();
+	ordered_ = ordered;
+}
+bool Wheelwriter::strikeOrdering() {
+	return ordered_;
+}
+void Wheelwriter::setEmphasisPasses(bool emphasisPasses) {
+	settle();
+	emphasisPasses_ = emphasisPasses;
+}
+bool Wheelwriter::emphasisPasses() {
+	return emphasisPasses_;
+}
+void Wheelwriter::setImpressionControl(bool impressionControl) {
+	settle();
+	impressionControl_ = impressionControl;
+	// Back to the normal impression
+	if (!impressionControl && (repeatMode_ & WW_IMPRESSION_MASK)) {
+		setRepeatMode((ww_repeat_mode)(repeatMode_ & ~WW_IMPRESSION_MASK));
+	}
+}
+bool Wheelwriter::impressionControl() {
+	return impressionControl_;
+}
+void Wheelwriter::_moveCarriageTo(int16_t x) {
+	int16_t usteps = x - carriageMicrospaces_;
+	while (usteps) {
+		uint16_t stepsAbs = (usteps > 0) ? usteps : -usteps;
+		if (stepsAbs > WW_CARRIAGE_MOVE_USTEP_MAX) {
+			stepsAbs = WW_CARRIAGE_MOVE_USTEP_MAX;
+		}
+		uint8_t direction = (usteps > 0) ? CARRIAGE_DIRECTION_RIGHT : CARRIAGE_DIRECTION_LEFT;
+		_sendCommandNow(MOVE_CARRIAGE, (stepsAbs >> 8) | direction, stepsAbs & 0xff);
+		if (usteps > 0) {
+			carriageMicrospaces_ += stepsAbs;
+			usteps -= stepsAbs;
+		}
+		else {
+			carriageMicrospaces_ -= stepsAbs;
+			usteps += stepsAbs;
 		}
-		return 0;
 	}
-
-	// Command
-	bufferIn_[1] = uart_->read();
-	if (bufferIn_[1] > 0xe) {
-		if (verbose == 2) {
-			sprintf(stringBuffer, "\nERROR: readCommand(): expected command < 0x0f! Got 0x%02x\n", bufferIn_[1]);
-			Serial.write(stringBuffer);
+}
+void Wheelwriter::_movePlatenPending() {
+	while (pendingPlatenMicrospaces_) {
+		uint16_t stepsAbs = (pendingPlatenMicrospaces_ > 0) ? pendingPlatenMicrospaces_ : -pendingPlatenMicrospaces_;
+		if (stepsAbs > WW_PLATEN_ADVANCE_USTEP_MAX) {
+			stepsAbs = WW_PLATEN_ADVANCE_USTEP_MAX;
+		}
+		if (pendingPlatenMicrospaces_ > 0) {
+			_sendCommandNow(MOVE_PLATEN, stepsAbs | PLATEN_DIRECTION_UP, 0);
+			pendingPlatenMicrospaces_ -= stepsAbs;
+		}
+		else {
+			_sendCommandNow(MOVE_PLATEN, stepsAbs | PLATEN_DIRECTION_DOWN, 0);
+			pendingPlatenMicrospaces_ += stepsAbs;
 		}
-		return 0;
 	}
-	if (verbose) {
-		sprintf(stringBuffer, ", CMD: 0x%02x", bufferIn_[1]);
-		Serial.write(stringBuffer);
+}
+void Wheelwriter::_remember(uint8_t wheelPosition, ww_typestyle style) {
+	if (overwrite_) {
+		_eraseRange(horizontalMicrospaces_, horizontalMicrospaces_ + charSpace_);
 	}
-
-	uint8_t commandLength = ww_command_length[bufferIn_[1]];
-
-	// Command ACK
-	response = uart_->read();
-	if (commandLength == 1) {
-		if (verbose) {
-			sprintf(stringBuffer, ", RSP: 0x%02x (%d ms)\n", response, millis()-startTime);
-			Serial.write(stringBuffer);
+	// A plain space leaves nothing to erase
+	if (!wheelPosition && ((style & 0xf0) != TYPESTYLE_UNDERLINE)) {
+		return;
+	}
+	if (corrections_.size() >= WW_CORRECTION_BUFFER_MAX) {
+		corrections_.erase(corrections_.begin());
+	}
+	corrections_.push_back({horizontalMicrospaces_, wheelPosition, (uint8_t)style});
+}
+void Wheelwriter::_eraseRange(int16_t from, int16_t to) {
+	// A character still held back is dropped rather than struck and erased
+	if (pendingCharacter_ && !corrections_.empty()) {
+		const Correction& last = corrections_.back();
+		if ((last.x >= from) && (last.x < to) && (last.wheelPosition == pendingCharacter_) && 
+		    (last.style == TYPESTYLE_NORMAL)) {
+			pendingCharacter_ = 0;
+			corrections_.pop_back();
 		}
-		return commandLength;
 	}
-	if ((commandLength > 1) && (response != 0)) {
-		if (verbose == 2) {
-			sprintf(stringBuffer, "\nERROR: readCommand(): expected command ACK = 0! Got 0x%02x\n", response);
-			Serial.write(stringBuffer);
+	size_t kept = 0;
+	for (size_t i = 0; i < corrections_.size(); i++) {
+		const Correction correction = corrections_[i];
+		if ((correction.x < from) || (correction.x >= to)) {
+			corrections_[kept++] = correction;
+			continue;
+		}
+		// Strikes still in the line buffer go on the paper before they come off
+		if (!lineBuffer_.empty()) {
+			_printLine();
+		}
+		if (correction.wheelPosition) {
+			pendingErases_.push_back({correction.x, correction.wheelPosition, LINE_PASS_GLYPH});
+			if ((correction.style & 0x0f) == TYPESTYLE_BOLD) {
+				pendingErases_.push_back({(int16_t)(correction.x + 1), correction.wheelPosition, LINE_PASS_BOLD});
+			}
+		}
+		if ((correction.style & 0xf0) == TYPESTYLE_UNDERLINE) {
+			pendingErases_.push_back({correction.x, (uint8_t)ascii2Printwheel('_'), LINE_PASS_UNDERLINE});
 		}
-		return 0;	
 	}
-
-	// Data1
-	bufferIn_[2] = uart_->read();
-	if (verbose) {
-		sprintf(stringBuffer, ", DT1: 0x%02x", bufferIn_[2]);
-		Serial.write(stringBuffer);
+	corrections_.resize(kept);
+	_deferMotion();
+}
+void Wheelwriter::_sendErases() {
+	// Left to right, with erases at the same position in the order queued
+	std::stable_sort(pendingErases_.begin(), pendingErases_.end(), [](const LineStrike& a, const LineStrike& b) {
+		return a.x < b.x;
+	});
+	// Usually the carriage is just right of what's being corrected, so this
+	// is a single sweep to the left
+	size_t count = pendingErases_.size();
+	bool reverse = abs(carriageMicrospaces_ - pendingErases_[count - 1].x) < abs(carriageMicrospaces_ - pendingErases_[0].x);
+	for (size_t i = 0; i < count; i++) {
+		const LineStrike& strike = pendingErases_[reverse ? (count - 1 - i) : i];
+		_moveCarriageTo(strike.x);
+		// Going right, a gap of up to 63 goes in the advance field
+		int16_t gap = (!reverse && (i + 1 < count)) ? (pendingErases_[i + 1].x - strike.x) : 0;
+		uint8_t advance = ((gap > 0) && (gap <= WW_CARRIAGE_ADVANCE_USTEP_MAX)) ? gap : 0;
+		_sendCommandNow(ERASE_CHARACTER_AND_ADVANCE, strike.wheelPosition, advance);
+		carriageMicrospaces_ += advance;
+	}
+	pendingErases_.clear();
+}
+bool Wheelwriter::_lineBuffered() {
+	return bidirectional_ || ordered_ || passLine_;
+}
+uint8_t Wheelwriter::_impression(uint8_t wheelPosition) {
+	if (!impressionControl_ || (wheelPosition >= WW_PRINTWHEEL_POSITIONS)) {
+		return repeatMode_ & WW_IMPRESSION_MASK;
+	}
+	uint8_t level = ww_keyboard_tables[printwheelTableIndex_].impression[wheelPosition];
+	return ww_capabilities_for_model(model_).impression[level];
+}
+void Wheelwriter::_strike(uint8_t wheelPosition, uint8_t pass) {
+	if (_lineBuffered()) {
+		// Erases queued before this strike go first
+		if (!pendingErases_.empty()) {
+			settle();
+		}
+		if (!emphasisPasses_) {
+			pass = LINE_PASS_GLYPH;
+		}
+		lineBuffer_.push_back({horizontalMicrospaces_, wheelPosition, pass, _impression(wheelPosition)});
+		if (lineBuffer_.size() >= WW_LINE_BUFFER_MAX) {
+			_printLine();
+		}
+		_deferMotion();
+	}
+	else {
+		sendCommand(TYPE_CHARACTER_NO_ADVANCE, wheelPosition, 0);
+	}
+}
+void Wheelwriter::_printLine() {
+	// The line goes on the row the platen has been moved to so far
+	_movePlatenPending();
+	// Strikes at the current impression go first, then each other impression
+	// in turn, each a pass at a time
+	uint8_t impression = repeatMode_ & WW_IMPRESSION_MASK;
+	std::stable_sort(lineBuffer_.begin(), lineBuffer_.end(), [impression](const LineStrike& a, const LineStrike& b) {
+		if (a.impression != b.impression) {
+			return (a.impression != impression) ? ((b.impression != impression) && (a.impression < b.impression)) : true;
+		}
+		return (a.pass != b.pass) ? (a.pass < b.pass) : (a.x < b.x);
+	});
+	// Each pass is ordered on its own, starting from where the last one ended
+	std::vector<uint16_t> order;
+	int16_t x = carriageMicrospaces_;
+	uint8_t wheel = wheelPosition_;
+	size_t end;
+	for (size_t begin = 0; begin < lineBuffer_.size(); begin = end) {
+		for (end = begin + 1; (end < lineBuffer_.size()) && (lineBuffer_[end].pass == lineBuffer_[begin].pass) &&
+		                      (lineBuffer_[end].impression == lineBuffer_[begin].impression); end++);
+		int16_t left = lineBuffer_[begin].x;
+		int16_t right = lineBuffer_[end - 1].x;
+		bool reverse = bidirectional_ && (abs(x - right) < abs(x - left));
+		std::vector<uint16_t> passOrder;
+		uint32_t cost = _orderLineSweep(passOrder, begin, end, x, wheel, reverse);
+		if (ordered_) {
+			std::vector<uint16_t> greedyOrder;
+			if (_orderLineGreedy(greedyOrder, begin, end, x, wheel) < cost) {
+				passOrder.swap(greedyOrder);
+			}
+		}
+		order.insert(order.end(), passOrder.begin(), passOrder.end());
+		x = lineBuffer_[order.back()].x;
+		wheel = lineBuffer_[order.back()].wheelPosition;
 	}
 
-	// Data1 ACK
-	response = uart_->read();
-	if (commandLength == 2) {
-		if (verbose) {
-			sprintf(stringBuffer, ", RSP: 0x%02x (%d ms)\n", response, millis()-startTime);
-			Serial.write(stringBuffer);
+	for (size_t i = 0; i < order.size(); i++) {
+		const LineStrike& strike = lineBuffer_[order[i]];
+		_moveCarriageTo(strike.x);
+		// A gap to the right of up to 63 goes in the advance field
+		int16_t gap = (i + 1 < order.size()) ? (lineBuffer_[order[i + 1]].x - strike.x) : 0;
+		if ((gap > 0) && (gap <= WW_CARRIAGE_ADVANCE_USTEP_MAX)) {
+			_sendCommandNow(TYPE_CHARACTER_AND_ADVANCE, strike.wheelPosition, gap);
+			carriageMicrospaces_ += gap;
+		}
+		else {
+			_sendCommandNow(TYPE_CHARACTER_NO_ADVANCE, strike.wheelPosition, 0);
 		}
-		return commandLength;
 	}
-	if ((commandLength > 2) && (response != 0)) {
-		if (verbose == 2) {
-			sprintf(stringBuffer, "\nERROR: readCommand(): expected data1 ACK = 0! Got 0x%02x\n", response);
-			Serial.write(stringBuffer);
+	lineBuffer_.clear();
+	passLine_ = false;
+}
+uint32_t Wheelwriter::_strikeCost(int16_t fromX, uint8_t fromWheel, int16_t x, uint8_t wheelPosition) {
+	uint8_t distance = (wheelPosition + WW_PRINTWHEEL_MAX - fromWheel) % WW_PRINTWHEEL_MAX;
+	if (distance > WW_PRINTWHEEL_MAX / 2) {
+		distance = WW_PRINTWHEEL_MAX - distance;
+	}
+	const ww_timing& timing = readiness_.timing();
+	uint32_t wheelTime = (uint32_t)distance * timing.wheelPerPosition;
+	uint32_t carriageTime = 0;
+	if (x != fromX) {
+		carriageTime = timing.carriageBase + (uint32_t)abs(x - fromX) * timing.carriagePerUstep;
+	}
+	// The wheel turns while the carriage moves
+	return (wheelTime > carriageTime) ? wheelTime : carriageTime;
+}
+uint32_t Wheelwriter::_orderLineSweep(std::vector<uint16_t>& order, size_t begin, size_t end, int16_t x,
+                                      uint8_t wheel, bool reverse) {
+	uint32_t cost = 0;
+	for (size_t i = begin; i < end; i++) {
+		uint16_t index = reverse ? (end - 1 - (i - begin)) : i;
+		cost += _strikeCost(x, wheel, lineBuffer_[index].x, lineBuffer_[index].wheelPosition);
+		x = lineBuffer_[index].x;
+		wheel = lineBuffer_[index].wheelPosition;
+		order.push_back(index);
+	}
+	return cost;
+}
+uint32_t Wheelwriter::_orderLineGreedy(std::vector<uint16_t>& order, size_t begin, size_t end, int16_t x,
+                                       uint8_t wheel) {
+	// Strikes at the same position (underlines, overstrikes) stay together and
+	// in the order they were typed
+	std::vector<uint16_t> groups;
+	for (size_t i = begin; i < end; i++) {
+		if ((i == begin) || (lineBuffer_[i].x != lineBuffer_[i - 1].x)) {
+			groups.push_back(i);
+		}
+	}
+	std::vector<bool> done(groups.size(), false);
+	uint32_t cost = 0;
+	for (size_t n = 0; n < groups.size(); n++) {
+		size_t best = 0;
+		uint32_t bestCost = UINT32_MAX;
+		for (size_t g = 0; g < groups.size(); g++) {
+			if (done[g]) continue;
+			const LineStrike& strike = lineBuffer_[groups[g]];
+			uint32_t groupCost = _strikeCost(x, wheel, strike.x, strike.wheelPosition);
+			if (groupCost < bestCost) {
+				best = g;
+				bestCost = groupCost;
+			}
+		}
+		done[best] = true;
+		cost += bestCost;
+		size_t groupEnd = (best + 1 < groups.size()) ? groups[best + 1] : end;
+		for (size_t i = groups[best]; i < groupEnd; i++) {
+			if (i != groups[best]) {
+				cost += _strikeCost(x, wheel, lineBuffer_[i].x, lineBuffer_[i].wheelPosition);
+			}
+			x = lineBuffer_[i].x;
+			wheel = lineBuffer_[i].wheelPosition;
+			order.push_back(i);
 		}
-		return 0;	
 	}
+	return cost;
+}
+void Wheelwriter::_passesForImpression(uint8_t wheelPosition) {
+	if (wheelPosition && !_lineBuffered() && (_impression(wheelPosition) != (repeatMode_ & WW_IMPRESSION_MASK))) {
+		// The line so far goes at this impression, the rest is buffered
+		settle();
+		passLine_ = true;
+	}
+}
+void Wheelwriter::_deferMotion() {
+	motionTime_ = millis();
+}
 
-	// Data2
-	bufferIn_[3] = uart_->read();
-	if (verbose) {
-		sprintf(stringBuffer, ", DT2: 0x%02x", bufferIn_[3]);
-		Serial.write(stringBuffer);
+uint8_t Wheelwriter::readCommand(uint8_t blocking, uint8_t verbose) {
+	// Frames to the other devices on the bus are skipped
+	while (true) {
+		pollBus();
+		if (frames_.read(frameIn_)) {
+			if (frameIn_.address == WW_MOTOR_CTRL_ADDR) {
+				break;
+			}
+		}
+		else if (!blocking) {
+			return 0;
+		}
 	}
 
-	// Data2 ACK
-	response = uart_->read();
-	if (commandLength == 3) {
-		if (verbose) {
-			sprintf(stringBuffer, ", RSP: 0x%02x (%d ms)\n", response, millis()-startTime);
+	if (verbose) {
+		sprintf(stringBuffer, "[%lu] ADR 0x%03x, CMD: 0x%02x", (unsigned long)(frameIn_.timestamp / 1000), 
+		        WW_ADDRESS_BIT | frameIn_.address, frameIn_.command);
+		Serial.write(stringBuffer);
+		if (frameIn_.length > 1) {
+			sprintf(stringBuffer, ", DT1: 0x%02x", frameIn_.data1);
 			Serial.write(stringBuffer);
 		}
-		return commandLength;
-	}
-	if ((commandLength > 3) && (response != 0)) {
-		if (verbose == 2) {
-			sprintf(stringBuffer, "\nERROR: readCommand(): expected data2 ACK = 0! Got 0x%02x\n", response);
+		if (frameIn_.length > 2) {
+			sprintf(stringBuffer, ", DT2: 0x%02x", frameIn_.data2);
 			Serial.write(stringBuffer);
 		}
-		return 0;	
+		sprintf(stringBuffer, ", RSP: 0x%02x (%lu ms)\n", frameIn_.acks[frameIn_.length], 
+		        (unsigned long)(frameIn_.duration / 1000));
+		Serial.write(stringBuffer);
 	}
+	return frameIn_.length;
+}
+void Wheelwriter::pollBus() {
+	if (busCore_) {
+		// The bus core only passes on what comes in while it is idle
+		engine_.service();
+	}
+	else if (!engine_.idle()) {
+		// While commands are queued, what comes in is theirs
+		return;
+	}
+	uint16_t word;
+	uint32_t timestamp;
+	while (_takeWord(word, timestamp)) {
+		frames_.receive(word, timestamp);
+	}
+}
+bool Wheelwriter::_takeWord(uint16_t& word, uint32_t& timestamp) {
+	if (busCore_) {
+		return busCore_->takeWord(word, timestamp);
+	}
+	if (!uart_->available()) {
+		return false;
+	}
+	word = uart_->read(timestamp);
+	return true;
+}
+BusFrameDecoder& Wheelwriter::frameDecoder() {
+	return frames_;
 }
 ww_keypress_type Wheelwriter::readKeypress(char& ascii, uint8_t blocking, uint8_t verbose) {
 	ascii = 0;
@@ -227,7 +545,7 @@ ww_keypress_type Wheelwriter::readKeypress(char& ascii, uint8_t blocking, uint8_
 	ww_platen_direction platenDir;
 	uint16_t platenDist;
 	ww_carriage_direction carriageDir;
-	uint8_t carriageDist;
+	uint16_t carriageDist;
 
 	// TODO - change this to look for 0x0c <keypress> 0x46 event
   //                             or 0x0c 0x50 0x08 event (backspace)
@@ -238,14 +556,14 @@ ww_keypress_type Wheelwriter::readKeypress(char& ascii, uint8_t blocking, uint8_
 	if (commandLength > 0) {
 		keypressType = NO_KEYPRESS;
 
-		switch (bufferIn_[1]) {
+		switch (frameIn_.command) {
 			case TYPE_CHARACTER_AND_ADVANCE:
-				ascii = usPrintwheel2AsciiTable[bufferIn_[2]];
+				ascii = printwheel2Ascii(frameIn_.data1);
 				keypressType = CHARACTER_KEYPRESS;
 				break;
 			case MOVE_PLATEN:
-				platenDist = bufferIn_[2] & 0x7f;
-				platenDir = (ww_platen_direction)(bufferIn_[2] & 0x80);
+				platenDist = frameIn_.data1 & 0x7f;
+				platenDir = (ww_platen_direction)(frameIn_.data1 & 0x80);
 				if ((platenDir == PLATEN_DIRECTION_UP) &&
 				    (platenDist == lineSpace_)) {
 					ascii = '\n';
@@ -253,8 +571,8 @@ ww_keypress_type Wheelwriter::readKeypress(char& ascii, uint8_t blocking, uint8_
 				}
 				break;
 			case MOVE_CARRIAGE:
-				carriageDist = (bufferIn_[2] & 0x7f << 8) | bufferIn_[3];
-				carriageDir = (ww_carriage_direction)(bufferIn_[2] & 0x80);
+				carriageDist = ((frameIn_.data1 & 0x07) << 8) | frameIn_.data2;
+				carriageDir = (ww_carriage_direction)(frameIn_.data1 & 0x80);
 				if ((carriageDist == charSpace_) ||
 				    (carriageDist == 10) || 
 				    (carriageDist == 12)) {
@@ -268,7 +586,7 @@ ww_keypress_type Wheelwriter::readKeypress(char& ascii, uint8_t blocking, uint8_
 				}
 				break;
 			case SEND_CODE:
-				ascii = bufferIn_[2];
+				ascii = frameIn_.data1;
 				keypressType = CODE_KEYPRESS;
 				break;
 			default:
@@ -281,63 +599,141 @@ ww_keypress_type Wheelwriter::readKeypress(char& ascii, uint8_t blocking, uint8_
 	}
 	return keypressType;
 }
-void Wheelwriter::waitReady(ww_command command) {
+bool Wheelwriter::waitReady(ww_command command) {
 	// No infinite recursion
 	if (command == QUERY_STATUS) {
 		readFlush(0);
-		return;
+		return true;
 	}
 
+	unsigned long startTime = millis();
+	readFlush(0);
 	while (true) {
-		readFlush(1);
 		uint8_t error, failIndex;
-		uint8_t status = _sendCommand(defaultAddress_, QUERY_STATUS, 0, 0, error, failIndex, 0);
-		Serial.write("waitReady() status: 0x");
-		Serial.println(status, HEX);
+		uint16_t status = _sendCommand(defaultAddress_, QUERY_STATUS, 0, 0, error, failIndex, 0);
+		if (error) {
+			_printCommandError(error, failIndex, status);
+			return false;
+		}
 		if (status == 0) {
-			return;
+			return true;
+		}
+		if ((millis() - startTime) > WW_WAIT_READY_TIMEOUT) {
+			Serial.write("waitReady() timeout, status: 0x");
+			Serial.println(status, HEX);
+			return false;
 		}
-		return;	// Disable the loop for now
-
-		Serial.write("waitReady() status: 0x");
-		Serial.println(status, HEX);
 		delayMicroseconds(1000);
 	}
 }
 void Wheelwriter::readFlush(bool verbose) {
-	uint8_t data;
+	uint16_t data;
+	// Queued transactions own the replies
+	flush();
 	if (verbose) {
 		Serial.write("Wheelwriter::readFlush()\n");
 	}
-	while (uart_->available()) {
-		uart_->read();
+	uint32_t timestamp;
+	while (_takeWord(data, timestamp)) {
 		if (verbose) {
 			Serial.write("    0x");
 			Serial.println(data, HEX);
 		}
 	}
+	frames_.clear();
 }
 bool Wheelwriter::available() {
-	return uart_->available();
+	pollBus();
+	return frames_.available();
 }
 
 char Wheelwriter::ascii2Printwheel(char ascii) {
-	return ascii2UsPrintwheelTable[printwheelTableIndex_][ascii];
+	return ww_keyboard_tables[printwheelTableIndex_].fromLatin1[(uint8_t)ascii];
 }
-void Wheelwriter::setKeyboard(uint16_t keyboard) {
-	keyboard_ = keyboard;
-	if (keyboard == KEYBOARD_ASCII) {
-		printwheelTableIndex_ = 1;
+uint8_t Wheelwriter::unicode2Printwheel(uint16_t codepoint) {
+	const ww_printwheel_tables& tables = ww_keyboard_tables[printwheelTableIndex_];
+	if (codepoint <= 0xff) {
+		return tables.fromLatin1[codepoint];
 	}
-	else {
-		printwheelTableIndex_ = 0;
+	if (tables.fromCyrillic && (codepoint >= WW_CYRILLIC_FIRST) && (codepoint < WW_CYRILLIC_FIRST + WW_CYRILLIC_LENGTH)) {
+		return tables.fromCyrillic[codepoint - WW_CYRILLIC_FIRST];
+	}
+	return 0;
+}
+uint16_t Wheelwriter::printwheel2Unicode(uint8_t wheelPosition) {
+	if (wheelPosition >= WW_PRINTWHEEL_POSITIONS) {
+		return 0;
 	}
+	return ww_keyboard_tables[printwheelTableIndex_].toUnicode[wheelPosition];
+}
+char Wheelwriter::printwheel2Ascii(uint8_t wheelPosition) {
+	uint16_t codepoint = printwheel2Unicode(wheelPosition);
+	return (codepoint <= 0xff) ? codepoint : 0;
+}
+void Wheelwriter::setKeyboard(uint16_t keyboard) {
+	keyboard_ = keyboard;
+	printwheelTableIndex_ = (keyboard < sizeof(ww_keyboard_table_index)) ? ww_keyboard_table_index[keyboard] : 0;
 }
 int16_t Wheelwriter::horizontalMicrospaces() {
 	return horizontalMicrospaces_;
 }
 void Wheelwriter::setLeftMargin() {
+	settle();
+	_moveCarriageTo(horizontalMicrospaces_);
+	leftMarginMicrospaces_ += horizontalMicrospaces_;
 	horizontalMicrospaces_ = 0;
+	carriageMicrospaces_ = 0;
+	corrections_.clear();
+}
+int16_t Wheelwriter::verticalMicrospaces() {
+	return verticalMicrospaces_;
+}
+void Wheelwriter::setTopOfPage() {
+	topOfPageMicrospaces_ += verticalMicrospaces_;
+	verticalMicrospaces_ = 0;
+}
+void Wheelwriter::saveContext(ww_typing_context& context) {
+	context.leftMargin = leftMarginMicrospaces_;
+	context.topOfPage = topOfPageMicrospaces_;
+	context.horizontal = horizontalMicrospaces_;
+	context.vertical = verticalMicrospaces_;
+	context.strikes = strikes_;
+	context.charSpace = charSpace_;
+	context.lineSpaceSingle = lineSpaceSingle_;
+	context.lineSpacing = lineSpacing_;
+	typeStream.saveContext(context);
+}
+void Wheelwriter::restoreContext(const ww_typing_context& context) {
+	settle();
+	charSpace_ = context.charSpace;
+	lineSpaceSingle_ = context.lineSpaceSingle;
+	lineSpacing_ = context.lineSpacing;
+	updateLineSpace();
+
+	// Whatever has been typed since is left alone. Without a line feed since
+	// the save, anything typed at all is on this line - including a stamp that
+	// the carriage has since been returned across.
+	bool platenMoved = (topOfPageMicrospaces_ + verticalMicrospaces_) != (context.topOfPage + context.vertical);
+	bool lineUsed = platenMoved ? (horizontalMicrospaces_ != 0) : (strikes_ != context.strikes);
+	if (lineUsed) {
+		lineFeed();
+	}
+	moveCarriageTo((int16_t)(context.leftMargin + context.horizontal - leftMarginMicrospaces_));
+	int16_t shift = leftMarginMicrospaces_ - context.leftMargin;
+	horizontalMicrospaces_ += shift;
+	carriageMicrospaces_ += shift;
+	leftMarginMicrospaces_ = context.leftMargin;
+	corrections_.clear();
+
+	topOfPageMicrospaces_ += verticalMicrospaces_ - context.vertical;
+	verticalMicrospaces_ = context.vertical;
+	typeStream.restoreContext(context);
+}
+uint16_t Wheelwriter::charSpace() {
+	return charSpace_;
+}
+uint8_t Wheelwriter::lineSpace() {
+	return lineSpace_;
 }
 void Wheelwriter::setCharSpace(uint16_t usteps) {
 	charSpace_ = usteps;
@@ -393,6 +789,7 @@ void Wheelwriter::setSpaceForWheel() {
 }
 ww_model Wheelwriter::queryModel() {
 	model_ = (ww_model)sendCommand(QUERY_MODEL);
+	readiness_.setTiming(ww_timing_for_model(model_));
 	return model_;
 }
 void Wheelwriter::typeAsciiInPlace(char ascii, ww_typestyle style) {
@@ -405,7 +802,7 @@ void Wheelwriter::typeAscii(char ascii, ww_typestyle style) {
 	typeAscii(ascii, charSpace_, style);
 }
 void Wheelwriter::typeAsciiString(char* string, uint8_t advanceUsteps, ww_typestyle style, bool newLine) {
-	for (int i = 0; i < strlen(string); i++) {
+	for (size_t i = 0; i < strlen(string); i++) {
 		typeAscii(string[i], advanceUsteps, style);
 	}
 	if (newLine) {
@@ -419,23 +816,77 @@ void Wheelwriter::typeAsciiString(char* string, ww_typestyle style, bool newLine
 void Wheelwriter::typeAsciiLine(char* string, ww_typestyle style) {
 	typeAsciiString(string, style, true);
 }
+void Wheelwriter::typeCentered(char* string, uint16_t width, ww_typestyle style, bool newLine) {
+	int16_t length = strlen(string);
+	carriageReturn();
+	if (length < width) {
+		moveCarriage((int16_t)(((width - length) * charSpace_) / 2));
+	}
+	typeAsciiString(string, style, newLine);
+}
+void Wheelwriter::typeRule(char ascii, uint16_t length, bool newLine) {
+	// The wheel stays put, so this is as quick as the carriage
+	for (uint16_t i = 0; i < length; i++) {
+		typeAscii(ascii);
+	}
+	if (newLine) {
+		carriageReturn();
+		lineFeed();
+	}
+}
 void Wheelwriter::typeCharacterInPlace(uint8_t wheelPosition, ww_typestyle style) {
-	sendCommand(TYPE_CHARACTER_NO_ADVANCE, wheelPosition, 0);
-	if ((style & 0xf0) == TYPESTYLE_UNDERLINE) {
-
-		sendCommand(TYPE_CHARACTER_NO_ADVANCE, ascii2Printwheel('_'), 0);	
+	_remember(wheelPosition, style);
+	_passesForImpression(wheelPosition);
+	bool hardwareUnderline = _syncUnderline(style);
+	if (emphasisPasses_ && (style != TYPESTYLE_NORMAL) && !hardwareUnderline && !_lineBuffered()) {
+		// The line so far has gone (or is held) as is, the rest is buffered
+		settle();
+		passLine_ = true;
+	}
+	// Position 0 is a space - nothing to strike, unless the typewriter underlines it
+	if (wheelPosition || hardwareUnderline) {
+		_strike(wheelPosition);
+	}
+	if (((style & 0xf0) == TYPESTYLE_UNDERLINE) && !hardwareUnderline) {
+		_strike(ascii2Printwheel('_'), LINE_PASS_UNDERLINE);
 	}
 	if ((style & 0x0f) == TYPESTYLE_BOLD) {
 		moveCarriage(1);
 
-		sendCommand(TYPE_CHARACTER_NO_ADVANCE, wheelPosition, 0);
+		if (wheelPosition) {
+			_strike(wheelPosition, LINE_PASS_BOLD);
+		}
 	}
 }
 void Wheelwriter::typeCharacter(uint8_t wheelPosition, uint8_t advanceUsteps, ww_typestyle style) {
-	if (style == TYPESTYLE_NORMAL) {
-
-		sendCommand(TYPE_CHARACTER_AND_ADVANCE, wheelPosition, advanceUsteps);
-		horizontalMicrospaces_ += advanceUsteps;
+	_passesForImpression(wheelPosition);
+	if (_syncUnderline(style)) {
+		// One command types, underlines and advances - spaces too, so they aren't held back
+		_remember(wheelPosition, style);
+		settle();
+		uint8_t advance = (advanceUsteps > WW_CARRIAGE_ADVANCE_USTEP_MAX) ? WW_CARRIAGE_ADVANCE_USTEP_MAX : advanceUsteps;
+		if (advance) {
+			sendCommand(TYPE_CHARACTER_AND_ADVANCE, wheelPosition, advance);
+		}
+		else {
+			sendCommand(TYPE_CHARACTER_NO_ADVANCE, wheelPosition, 0);
+		}
+		horizontalMicrospaces_ += advance;
+		carriageMicrospaces_ += advance;
+		moveCarriage((int16_t)(advanceUsteps - advance));
+	}
+	else if (style == TYPESTYLE_NORMAL) {
+		// Spaces are just moves. A character is held until whatever comes next,
+		// so the moves that follow it can go in its advance field.
+		_remember(wheelPosition, style);
+		if (wheelPosition && _lineBuffered()) {
+			_strike(wheelPosition);
+		}
+		else if (wheelPosition) {
+			settle();
+			pendingCharacter_ = wheelPosition;
+		}
+		moveCarriage((int16_t)advanceUsteps);
 	}
 	else {
 		typeCharacterInPlace(wheelPosition, style);
@@ -449,8 +900,33 @@ void Wheelwriter::typeCharacter(uint8_t wheelPosition, ww_typestyle style) {
 	typeCharacter(wheelPosition, charSpace_, style);
 }
 void Wheelwriter::eraseCharacter(uint8_t wheelPosition, uint8_t advanceUsteps, ww_typestyle style) {
+	// The carriage has to be over the character, wherever the last line left it
+	settle();
+	_moveCarriageTo(horizontalMicrospaces_);
 	sendCommand(ERASE_CHARACTER_AND_ADVANCE, wheelPosition, advanceUsteps);
+	for (size_t i = 0; i < corrections_.size(); i++) {
+		if ((corrections_[i].x == horizontalMicrospaces_) && (corrections_[i].wheelPosition == wheelPosition)) {
+			corrections_.erase(corrections_.begin() + i);
+			break;
+		}
+	}
+	horizontalMicrospaces_ += advanceUsteps;
+	carriageMicrospaces_ += advanceUsteps;
+}
+void Wheelwriter::backspace(uint16_t characters, bool erase) {
+	int16_t x = horizontalMicrospaces_ - (int16_t)(characters * charSpace_);
+	if (erase) {
+		_eraseRange(x, horizontalMicrospaces_);
+	}
+	moveCarriage((int16_t)(x - horizontalMicrospaces_));
+}
+void Wheelwriter::setOverwrite(bool overwrite) {
+	overwrite_ = overwrite;
+}
+bool Wheelwriter::overwrite() {
+	return overwrite_;
 }
+// Carriage and platen moves are only recorded here, and sent by settle()
 void Wheelwriter::movePlaten(int8_t usteps) {
 	ww_platen_direction direction = PLATEN_DIRECTION_UP;
 	if (usteps < 0) {
@@ -459,8 +935,24 @@ void Wheelwriter::movePlaten(int8_t usteps) {
 	movePlaten(abs(usteps), direction);
 }
 void Wheelwriter::movePlaten(uint8_t usteps, ww_platen_direction direction) {
+	// Strikes so far belong to the row we're leaving
+	if (!lineBuffer_.empty()) {
+		_printLine();
+	}
 	usteps = usteps & 0x7f; // 7-bit value
-	sendCommand(MOVE_PLATEN, usteps | direction);
+	// A new line - nothing on it to correct yet
+	if (usteps) {
+		corrections_.clear();
+	}
+	if (direction == PLATEN_DIRECTION_UP) {
+		pendingPlatenMicrospaces_ += usteps;
+		verticalMicrospaces_ += usteps;
+	}
+	else {
+		pendingPlatenMicrospaces_ -= usteps;
+		verticalMicrospaces_ -= usteps;
+	}
+	_deferMotion();
 }
 void Wheelwriter::moveCarriage(int16_t usteps) {
 	ww_carriage_direction direction = CARRIAGE_DIRECTION_RIGHT;
@@ -470,21 +962,35 @@ void Wheelwriter::moveCarriage(int16_t usteps) {
 	moveCarriage(abs(usteps), direction);
 }
 void Wheelwriter::moveCarriage(uint16_t usteps, ww_carriage_direction direction) {
-	uint16_t stepsAbs = usteps & 0x07ff; // 11-bit value
-	uint8_t byte1 = (stepsAbs >> 8) | direction;
-	uint8_t byte2 = stepsAbs & 0x00ff;
-
-	sendCommand(MOVE_CARRIAGE, byte1, byte2);
 	if (direction == CARRIAGE_DIRECTION_RIGHT) {
 		horizontalMicrospaces_ += usteps;
 	}
 	else {
 		horizontalMicrospaces_ -= usteps;
 	}
+	_deferMotion();
 }
 void Wheelwriter::moveCarriageSpaces(int16_t spaces) {
 	moveCarriage(spaces*charSpace_);
 }
+void Wheelwriter::moveCarriageTo(int16_t x) {
+	moveCarriage((int16_t)(x - horizontalMicrospaces_));
+}
+void Wheelwriter::movePlatenTo(int16_t y) {
+	// movePlaten() takes 7 bits at a time. The moves are merged again by settle().
+	int16_t usteps = y - verticalMicrospaces_;
+	while (usteps) {
+		int16_t step = usteps;
+		if (step > WW_PLATEN_ADVANCE_USTEP_MAX) {
+			step = WW_PLATEN_ADVANCE_USTEP_MAX;
+		}
+		else if (step < -WW_PLATEN_ADVANCE_USTEP_MAX) {
+			step = -WW_PLATEN_ADVANCE_USTEP_MAX;
+		}
+		movePlaten((int8_t)step);
+		usteps -= step;
+	}
+}
 void Wheelwriter::carriageReturn() {
 	moveCarriage(-horizontalMicrospaces_);
 	horizontalMicrospaces_ = 0;
@@ -501,6 +1007,29 @@ ww_printwheel Wheelwriter::queryPrintwheel() {
 void Wheelwriter::setRepeatMode(ww_repeat_mode repeatMode) {
 	sendCommand(SET_REPEAT_MODE, repeatMode);
 }
+void Wheelwriter::clearRepeatMode() {
+	if (repeatMode_ != REPEAT_OFF) {
+		setRepeatMode(REPEAT_OFF);
+	}
+}
+bool Wheelwriter::supportsRepeatMode(ww_repeat_mode repeatMode) {
+	return hardwareRepeatModes_ && ((ww_repeat_modes_for_model(model_) & repeatMode) == repeatMode);
+}
+void Wheelwriter::setHardwareRepeatModes(bool enable) {
+	hardwareRepeatModes_ = enable;
+	if (!enable) {
+		clearRepeatMode();
+	}
+}
+bool Wheelwriter::_syncUnderline(ww_typestyle style) {
+	// Buffered lines are struck out of order, so underlines have to be struck with them. 
+	// Bold is struck twice, and would be underlined twice.
+	bool underline = (style == TYPESTYLE_UNDERLINE) && supportsRepeatMode(UNDERLINE) && !_lineBuffered();
+	if (underline != (bool)(repeatMode_ & UNDERLINE)) {
+		setRepeatMode((ww_repeat_mode)(repeatMode_ ^ UNDERLINE));
+	}
+	return underline;
+}
 ww_status Wheelwriter::queryStatus() {
 	return (ww_status)sendCommand(QUERY_STATUS);
 }
@@ -523,25 +1052,20 @@ void Wheelwriter::setDefaultAddress(uint8_t address) {
 }
 // 
 void Wheelwriter::bufferTest(uint16_t numChars, uint8_t charsPerLine) {
-	char buffer[] = "123456789.";
-	uint8_t index = 0;
-	uint8_t bufferSize = strlen(buffer);
-	uint16_t charsTyped = 0;
-
 	this->setSpaceForWheel();
 	this->setLeftMargin();
 
-	while (charsTyped < numChars) {
-		index = index % bufferSize;
-		this->typeAscii(buffer[index]);
-		charsTyped++;
-		index++;
-		if ((charsTyped % charsPerLine) == 0) {
-			this->carriageReturn();
-			this->lineFeed();
-		}
+	for (uint16_t index = 0; index < numChars; index++) {
+		this->bufferTestCharacter(index, numChars, charsPerLine);
 	}
-	if (charsTyped % charsPerLine) {
+}
+void Wheelwriter::bufferTestCharacter(uint16_t index, uint16_t numChars, uint8_t charsPerLine) {
+	char buffer[] = "123456789.";
+	uint8_t bufferSize = strlen(buffer);
+
+	this->typeAscii(buffer[index % bufferSize]);
+	uint16_t charsTyped = index + 1;
+	if (((charsTyped % charsPerLine) == 0) || (charsTyped == numChars)) {
 		this->carriageReturn();
 		this->lineFeed();
 	}
@@ -561,7 +1085,7 @@ void Wheelwriter::circleTest() {
 
   // Move to center
   moveCarriage(100);
-  for (int i = 0; i < strlen(buffer); i++) {
+  for (size_t i = 0; i < strlen(buffer); i++) {
     typeAsciiInPlace(buffer[i]);
     if (i == strlen(buffer) - 1) break;
     moveCarriage(dx[i]);
@@ -590,76 +1114,69 @@ void Wheelwriter::characterTest(wheelwriter::ww_typestyle style) {
 }
 
 void Wheelwriter::printwheelSample(uint8_t plusPosition, uint8_t underscorePosition) {
-  // A printwheel has 96 (0x60) characters
-  // This prints in a pair 16 x 6 arrays (regular and bold) with a border of alignment marks
-
-  wheelwriter::ww_typestyle typestyle = wheelwriter::TYPESTYLE_NORMAL;
   setSpaceForWheel();
   setLeftMargin();
 
-  // Row 0
-  typeCharacter(plusPosition, typestyle);
-  typeCharacter(plusPosition, typestyle);
-  typeCharacter(underscorePosition, typestyle);
-  moveCarriageSpaces(7);
-  typeCharacter(plusPosition, typestyle);
-  moveCarriageSpaces(9);
-  typeCharacter(plusPosition, typestyle);
-  carriageReturn();
-  lineFeed();
-
-  // Row 1
-  typeCharacter(plusPosition, typestyle);
-  carriageReturn();
-  lineFeed();
+  for (uint8_t line = 0; line < WW_PRINTWHEEL_SAMPLE_LINES; line++) {
+    printwheelSampleLine(line, plusPosition, underscorePosition);
+  }
+}
+uint8_t Wheelwriter::printwheelSampleLine(uint8_t line, uint8_t plusPosition, uint8_t underscorePosition) {
+  // A printwheel has 96 (0x60) characters
+  // This prints in a pair 16 x 6 arrays (regular and bold) with a border of alignment marks
+  uint8_t glyphs = 0;
 
-  // Row 2-14
-  for (int sample = 0; sample < 2; sample++) {
-    switch (sample) {
-      case 0:
-        typestyle = wheelwriter::TYPESTYLE_NORMAL;
-        break;
-      case 1:
-        typestyle = wheelwriter::TYPESTYLE_BOLD;
-        break;
-    }
-    // Type all 96 printwheel positions in a 16 x 8 array
-    uint8_t wheelPosition = 1;
-    for (int row = 0; row < 6; row++) {
-      moveCarriageSpaces(2);
-      for (int i = 0; i < 16; i++, wheelPosition++) {
-        typeCharacter(wheelPosition, typestyle);
-        // Space after the 8th character
-        if (i == 7) {
-          moveCarriageSpaces(1);
-        }
-      }
-      carriageReturn();
-      lineFeed();
-    }
+  if (line == 0) {
+    // Row 0
+    typeCharacter(plusPosition, TYPESTYLE_NORMAL);
+    typeCharacter(plusPosition, TYPESTYLE_NORMAL);
+    typeCharacter(underscorePosition, TYPESTYLE_NORMAL);
+    moveCarriageSpaces(7);
+    typeCharacter(plusPosition, TYPESTYLE_NORMAL);
+    moveCarriageSpaces(9);
+    typeCharacter(plusPosition, TYPESTYLE_NORMAL);
+    glyphs = 5;
+  }
+  else if (line == 1) {
+    // Row 1
+    typeCharacter(plusPosition, TYPESTYLE_NORMAL);
+    glyphs = 1;
+  }
+  else if (line == 8) {
     // Space between samples
-    if (sample == 0) {
-      typeCharacter(plusPosition, typestyle);
-      moveCarriageSpaces(19);
-      typeCharacter(plusPosition, typestyle);
-      carriageReturn();
-      lineFeed();
+    typeCharacter(plusPosition, TYPESTYLE_NORMAL);
+    moveCarriageSpaces(19);
+    typeCharacter(plusPosition, TYPESTYLE_NORMAL);
+    glyphs = 2;
+  }
+  else if (line < 15) {
+    // Rows 2-7 regular, 9-14 bold: all 96 printwheel positions in a 16 x 6 array
+    uint8_t row = (line < 8) ? (line - 2) : (line - 9);
+    ww_typestyle typestyle = (line < 8) ? TYPESTYLE_NORMAL : TYPESTYLE_BOLD;
+    uint8_t wheelPosition = 1 + row * 16;
+    moveCarriageSpaces(2);
+    for (int i = 0; i < 16; i++, wheelPosition++) {
+      typeCharacter(wheelPosition, typestyle);
+      // Space after the 8th character
+      if (i == 7) {
+        moveCarriageSpaces(1);
+      }
     }
+    glyphs = 16;
   }
-  typestyle = wheelwriter::TYPESTYLE_NORMAL;
-  
-  // Row 15
-  carriageReturn();
-  lineFeed();
-
-  // Row 16
-  typeCharacter(plusPosition, typestyle);
-  moveCarriageSpaces(9);
-  typeCharacter(plusPosition, typestyle);
-  moveCarriageSpaces(9);
-  typeCharacter(plusPosition, typestyle);
+  else if (line == 16) {
+    // Row 16
+    typeCharacter(plusPosition, TYPESTYLE_NORMAL);
+    moveCarriageSpaces(9);
+    typeCharacter(plusPosition, TYPESTYLE_NORMAL);
+    moveCarriageSpaces(9);
+    typeCharacter(plusPosition, TYPESTYLE_NORMAL);
+    glyphs = 3;
+  }
+  // Row 15 is left blank
   carriageReturn();
   lineFeed();
+  return glyphs;
 }
 
 void Wheelwriter::queryToJson(std::string& json) {
@@ -726,156 +1243,279 @@ void Wheelwriter::queryToJson(std::string& json) {
 // Wheelwriter::TypeStream class
 // =================
 
+// Escape and caret sequences, by state and class of byte
+const Wheelwriter::TypeStream::Transition Wheelwriter::TypeStream::transitions_[STATES][BYTE_CLASSES] = {
+//   TEXT                      EOT                       NEWLINE                   ESC                       CARAT                     BRACKET                   DIGIT                     SEPARATOR                 D                         FINAL                     BS                          DEL
+	{{ACTION_TEXT, NORMAL},    {ACTION_EOT, NORMAL},     {ACTION_NEWLINE, NORMAL}, {ACTION_START, ESCAPE},   {ACTION_CARAT, CARAT},    {ACTION_TEXT, NORMAL},    {ACTION_TEXT, NORMAL},    {ACTION_TEXT, NORMAL},    {ACTION_TEXT, NORMAL},    {ACTION_TEXT, NORMAL},    {ACTION_BACKSPACE, NORMAL}, {ACTION_DELETE, NORMAL}},  // NORMAL
+	{{ACTION_INVALID, NORMAL}, {ACTION_INVALID, NORMAL}, {ACTION_INVALID, NORMAL}, {ACTION_INVALID, NORMAL}, {ACTION_INVALID, NORMAL}, {ACTION_STORE, ESCAPE},   {ACTION_INVALID, NORMAL}, {ACTION_INVALID, NORMAL}, {ACTION_EOT, NORMAL},     {ACTION_INVALID, NORMAL}, {ACTION_INVALID, NORMAL},   {ACTION_INVALID, NORMAL}}, // CARAT - ^D, ^[
+	{{ACTION_INVALID, NORMAL}, {ACTION_INVALID, NORMAL}, {ACTION_INVALID, NORMAL}, {ACTION_INVALID, NORMAL}, {ACTION_INVALID, NORMAL}, {ACTION_STORE, CSI},      {ACTION_INVALID, NORMAL}, {ACTION_INVALID, NORMAL}, {ACTION_INVALID, NORMAL}, {ACTION_INVALID, NORMAL}, {ACTION_INVALID, NORMAL},   {ACTION_INVALID, NORMAL}}, // ESCAPE - ESC[
+	{{ACTION_INVALID, NORMAL}, {ACTION_INVALID, NORMAL}, {ACTION_INVALID, NORMAL}, {ACTION_INVALID, NORMAL}, {ACTION_FINAL, NORMAL},   {ACTION_FINAL, NORMAL},   {ACTION_DIGIT, CSI},      {ACTION_SEPARATOR, CSI},  {ACTION_FINAL, NORMAL},   {ACTION_FINAL, NORMAL},   {ACTION_INVALID, NORMAL},   {ACTION_INVALID, NORMAL}}  // CSI - parameters, final byte
+};
+// Select Graphic Rendition parameters - the style is ANDed with keep then ORed with set
+const Wheelwriter::TypeStream::SgrParameter Wheelwriter::TypeStream::sgrParameters_[] = {
+	{0,  0x00, TYPESTYLE_NORMAL,    LINESPACING_ONE},   // Normal
+	{1,  0xff, TYPESTYLE_BOLD,      -1},                // Bold
+	{4,  0xff, TYPESTYLE_UNDERLINE, -1},                // Underline
+	{10, 0xff, TYPESTYLE_NORMAL,    LINESPACING_ONE},   // Single space
+	{11, 0xff, TYPESTYLE_NORMAL,    LINESPACING_ONE_POINT_FIVE},
+	{12, 0xff, TYPESTYLE_NORMAL,    LINESPACING_TWO},
+	{13, 0xff, TYPESTYLE_NORMAL,    LINESPACING_THREE},
+	{22, 0xf0, TYPESTYLE_NORMAL,    -1},                // Not bold
+	{24, 0x0f, TYPESTYLE_NORMAL,    -1}                 // Not underlined
+};
+
+Wheelwriter::TypeStream::ByteClass Wheelwriter::TypeStream::classify(uint8_t inByte) {
+	switch (inByte) {
+		case 0x04: return BYTE_EOT;
+		case 0x08: return BYTE_BACKSPACE;
+		case 0x0a: return BYTE_NEWLINE;
+		case 0x1b: return BYTE_ESCAPE;
+		case 0x7f: return BYTE_DELETE;
+		case '^':  return BYTE_CARAT;
+		case '[':  return BYTE_BRACKET;
+		case ';':  return BYTE_SEPARATOR;
+		case 'd':
+		case 'D':  return BYTE_D;
+	}
+	if ((inByte >= '0') && (inByte <= '9')) {
+		return BYTE_DIGIT;
+	}
+	if ((inByte >= 0x40) && (inByte <= 0x7e)) {
+		return BYTE_FINAL;
+	}
+	return BYTE_TEXT;
+}
 int Wheelwriter::TypeStream::type(char inByte) {
-	switch (state_) {
-		case NORMAL: {
-			// Control sequence start - ^
-			if (useCaratAsControl_ && inByte == '^') {
-				buffer_ += inByte;
-				state_ = CARAT;
-			}
-			// EOT (CTRL-D)
-			else if (inByte == 0x04) {
-				reset();
-				return 0;
-			}
-			// New line
-			else if (inByte == 0x0a) {
-				typewriter_.carriageReturn();
-				typewriter_.lineFeed();
-			}
-			// Escape character
-			else if (inByte == 0x1b) {
-				buffer_ += inByte;
-				state_ = ESCAPE;
-			}
-			else {
-				typewriter_.typeAscii(inByte, typestyle_);
-			}
+	// A UTF-8 sequence cut short by anything else wasn't UTF-8
+	if (utf8Length_ && (((uint8_t)inByte & 0xc0) != 0x80)) {
+		flushUtf8();
+	}
+	const Transition& transition = transitions_[state_][classify(inByte)];
+	state_ = transition.next;
+	switch (transition.action) {
+		case ACTION_TEXT:
+			typeText(inByte);
 			break;
-		}
-		case CARAT: {
-			// EOT - ^D
-			if ((inByte == 'd') || (inByte == 'D')) {
-				reset();
-				return 0;
-			}
-			// ANSI escape sequence - ^[
-			else if (inByte == '[') {
-				buffer_ += inByte;
-				state_ = ESCAPE;
-			}
-			// Invalid control sequnece
-			else {
-				buffer_ += inByte;
-				flushBuffer();
-				state_ = NORMAL;
-			}
+		case ACTION_EOT:
+			reset();
+			typewriter_.clearRepeatMode();
+			return 0;
+		case ACTION_NEWLINE:
+			typewriter_.carriageReturn();
+			typewriter_.lineFeed();
 			break;
-		}
-		case ESCAPE: {
-			// ANSI escape sequence - ^[[<value> m
-			if (inByte == '[') {
-				buffer_ += inByte;
-				state_ = CSI;
-			}
-			else {
-				buffer_ += inByte;
-				flushBuffer();
+		case ACTION_CARAT:
+			if (!useCaratAsControl_) {
 				state_ = NORMAL;
+				typeText(inByte);
+				break;
 			}
+			// Fall through - ^ starts a sequence
+		case ACTION_START:
+			sequenceLength_ = 0;
+			parameterCount_ = 0;
+			digits_ = 0;
+			parameters_[0] = 0;
+			sequence_[sequenceLength_++] = inByte;
 			break;
-		}
-		case CSI: {
-			if (inByte == 'm') {
-				if (parseEscape(buffer_, typestyle_, lineSpacing_)) {
-					typewriter_.setLineSpacing(lineSpacing_);
-					buffer_.clear();
-				}
-				else {
-					flushBuffer();
-				}
-				state_ = NORMAL;
+		case ACTION_STORE:
+			sequence_[sequenceLength_++] = inByte;
+			break;
+		case ACTION_DIGIT:
+			sequence_[sequenceLength_++] = inByte;
+			if (++digits_ > WW_CSI_DIGITS_MAX) {
+				flushSequence();
+				break;
 			}
-			else if (isdigit(inByte)) {
-				buffer_ += inByte;
-				// Too many digits
-				if ((buffer_.size()-digitOffset(buffer_)) > 2) {
-					flushBuffer();
-					state_ = NORMAL;
-				}
+			parameters_[parameterCount_] = parameters_[parameterCount_] * 10 + (inByte - '0');
+			break;
+		case ACTION_SEPARATOR:
+			sequence_[sequenceLength_++] = inByte;
+			if (++parameterCount_ >= WW_CSI_PARAMETERS_MAX) {
+				flushSequence();
+				break;
 			}
-			// Invalid ANSI escape sequence
-			else {
-				buffer_ += inByte;
-				flushBuffer();
-				state_ = NORMAL;
+			parameters_[parameterCount_] = 0;
+			digits_ = 0;
+			break;
+		case ACTION_FINAL:
+			sequence_[sequenceLength_++] = inByte;
+			if (!dispatch(inByte, parameterCount_ + 1)) {
+				flushSequence();
 			}
 			break;
+		case ACTION_BACKSPACE:
+			typewriter_.backspace(1, false);
+			break;
+		case ACTION_DELETE:
+			typewriter_.backspace(1, true);
+			break;
+		case ACTION_INVALID:
+			sequence_[sequenceLength_++] = inByte;
+			flushSequence();
+			break;
+	}
+	return 1;
+}
+bool Wheelwriter::TypeStream::dispatch(char final, uint8_t count) {
+	// Counts and positions default to 1 when left out (or 0). They go up to
+	// 9999, so the target is worked out in 32 bits and kept within the carriage
+	// travel and the page.
+	int32_t first = parameters_[0] ? parameters_[0] : 1;
+	int32_t second = ((count > 1) && parameters_[1]) ? parameters_[1] : 1;
+	int32_t charSpace = typewriter_.charSpace();
+	int32_t lineSpace = typewriter_.lineSpace();
+	int32_t x = typewriter_.horizontalMicrospaces();
+	int32_t y = typewriter_.verticalMicrospaces();
+	switch (final) {
+		case 'm':
+			return selectGraphicRendition(count);
+		case 'H':  // CUP - cursor position, row;column
+		case 'f':
+			x = (second - 1) * charSpace;
+			y = (first - 1) * lineSpace;
+			break;
+		case 'A':  // CUU - up
+			y -= first * lineSpace;
+			break;
+		case 'B':  // CUD - down
+			y += first * lineSpace;
+			break;
+		case 'C':  // CUF - forward
+			x += first * charSpace;
+			break;
+		case 'D':  // CUB - back
+			x -= first * charSpace;
+			break;
+		case '`':  // HPA - column
+		case 'G':  // CHA - column
+			x = (first - 1) * charSpace;
+			break;
+		case 'd':  // VPA - row
+			y = (first - 1) * lineSpace;
+			break;
+		default:
+			return false;
+	}
+	x = std::min(std::max(x, (int32_t)0), WW_CARRIAGE_USTEP_MAX - typewriter_.leftMarginMicrospaces_);
+	y = std::min(std::max(y, (int32_t)0), (int32_t)WW_PAGE_LENGTH);
+	typewriter_.moveCarriageTo((int16_t)x);
+	typewriter_.movePlatenTo((int16_t)y);
+	return true;
+}
+bool Wheelwriter::TypeStream::selectGraphicRendition(uint8_t count) {
+	// Nothing changes unless every parameter is known
+	uint8_t typestyle = typestyle_;
+	ww_linespacing lineSpacing = lineSpacing_;
+	for (uint8_t i = 0; i < count; i++) {
+		size_t j = 0;
+		while ((j < sizeof(sgrParameters_) / sizeof(sgrParameters_[0])) && (sgrParameters_[j].value != parameters_[i])) {
+			j++;
+		}
+		if (j == sizeof(sgrParameters_) / sizeof(sgrParameters_[0])) {
+			return false;
+		}
+		typestyle = (typestyle & sgrParameters_[j].keep) | sgrParameters_[j].set;
+		if (sgrParameters_[j].lineSpacing >= 0) {
+			lineSpacing = (ww_linespacing)sgrParameters_[j].lineSpacing;
 		}
 	}
-	return state_;
-}
-int Wheelwriter::TypeStream::parseEscape(const std::string& buffer, wheelwriter::ww_typestyle& typestyle, wheelwriter::ww_linespacing& lineSpacing) {
-	size_t offset = digitOffset(buffer);
-
-	const char* start = buffer.c_str()+offset;
-  char* end;
-  long value = strtol(start, &end, 10);
-  if (end != start) {
-    switch (value) {
-      case 0:  // Normal
-        typestyle = wheelwriter::TYPESTYLE_NORMAL;
-        lineSpacing = wheelwriter::LINESPACING_ONE;
-        break;
-      case 1:  // Bold
-        typestyle = (wheelwriter::ww_typestyle)((uint8_t)typestyle | (uint8_t)wheelwriter::TYPESTYLE_BOLD);
-        break;
-      case 4:  // Underline
-        typestyle = (wheelwriter::ww_typestyle)((uint8_t)typestyle | (uint8_t)wheelwriter::TYPESTYLE_UNDERLINE);
-        break;
-      case 10: // Single space
-        lineSpacing = wheelwriter::LINESPACING_ONE;
-        break;
-      case 11: // 1.5 space
-        lineSpacing = wheelwriter::LINESPACING_ONE_POINT_FIVE;
-        break;
-      case 12: // Double space
-        lineSpacing = wheelwriter::LINESPACING_TWO;
-        break;
-      case 13: // Triple space
-        lineSpacing = wheelwriter::LINESPACING_THREE;
-        break;
-      case 22: // Not bold
-        typestyle = (wheelwriter::ww_typestyle)((uint8_t)typestyle & 0xf0);
-        break;
-      case 24: // Not underlined
-        typestyle = (wheelwriter::ww_typestyle)((uint8_t)typestyle & 0x0f);
-        break;
-      default: // Invalid value
-       	return 0;
-    }
-    return 1; // Valid escape
-  }
-  return 0; // Invalid escape sequence - in theory this should never be reached if the front end filtering is working
+	typestyle_ = (ww_typestyle)typestyle;
+	lineSpacing_ = lineSpacing;
+	typewriter_.setLineSpacing(lineSpacing_);
+	return true;
 }
-size_t Wheelwriter::TypeStream::digitOffset(const std::string& buffer) {
-	for (size_t i = 0; i < buffer.size(); i++) {
-		if (isdigit(buffer[i])) {
-			return i;
+void Wheelwriter::TypeStream::flushSequence() {
+	// Not a sequence we know - type it as it came
+	state_ = NORMAL;
+	for (uint8_t i = 0; i < sequenceLength_; i++) {
+		typewriter_.typeAscii(sequence_[i], typestyle_);
+	}
+	sequenceLength_ = 0;
+}
+void Wheelwriter::TypeStream::typeText(char inByte) {
+	if (utf8_) {
+		decodeUtf8(inByte);
+	}
+	else {
+		typewriter_.typeAscii(inByte, typestyle_);
+	}
+}
+void Wheelwriter::TypeStream::decodeUtf8(uint8_t inByte) {
+	if (utf8Length_) {
+		// Continuation byte - anything else was flushed by type()
+		utf8Bytes_[utf8Count_++] = inByte;
+		codepoint_ = (codepoint_ << 6) | (inByte & 0x3f);
+		if (utf8Count_ < utf8Length_) {
+			return;
+		}
+		// Overlong encodings and surrogates aren't valid UTF-8
+		static const uint32_t minimum[5] = {0, 0, 0x80, 0x800, 0x10000};
+		if ((codepoint_ < minimum[utf8Length_]) || ((codepoint_ >= 0xd800) && (codepoint_ <= 0xdfff)) ||
+		    (codepoint_ > 0x10ffff)) {
+			flushUtf8();
+			return;
 		}
+		utf8Length_ = 0;
+		typeCodepoint(codepoint_);
+		return;
+	}
+	if (inByte < 0x80) {
+		typeCodepoint(inByte);
+		return;
+	}
+	if ((inByte & 0xe0) == 0xc0) {
+		utf8Length_ = 2;
+		codepoint_ = inByte & 0x1f;
+	}
+	else if ((inByte & 0xf0) == 0xe0) {
+		utf8Length_ = 3;
+		codepoint_ = inByte & 0x0f;
+	}
+	else if ((inByte & 0xf8) == 0xf0) {
+		utf8Length_ = 4;
+		codepoint_ = inByte & 0x07;
+	}
+	else {
+		// A stray continuation byte or a byte that can't start a sequence
+		typeCodepoint(inByte);
+		return;
 	}
-	return buffer.size();
+	utf8Bytes_[0] = inByte;
+	utf8Count_ = 1;
 }
-void Wheelwriter::TypeStream::flushBuffer() {
-	for (char c : buffer_) {
-		typewriter_.typeAscii(c, typestyle_);
+void Wheelwriter::TypeStream::flushUtf8() {
+	uint8_t count = utf8Count_;
+	utf8Length_ = 0;
+	for (uint8_t i = 0; i < count; i++) {
+		typeCodepoint(utf8Bytes_[i]);
 	}
-	buffer_.clear();
+}
+void Wheelwriter::TypeStream::typeCodepoint(uint32_t codepoint) {
+	uint8_t wheelPosition = (codepoint <= 0xffff) ? typewriter_.unicode2Printwheel(codepoint) : 0;
+	typewriter_.typeCharacter(wheelPosition, typestyle_);
+}
+void Wheelwriter::TypeStream::saveContext(ww_typing_context& context) {
+	context.typestyle = typestyle_;
+	context.streamLineSpacing = lineSpacing_;
+	context.useCaratAsControl = useCaratAsControl_;
+	context.utf8 = utf8_;
+}
+void Wheelwriter::TypeStream::restoreContext(const ww_typing_context& context) {
+	reset();
+	typestyle_ = context.typestyle;
+	lineSpacing_ = context.streamLineSpacing;
+	useCaratAsControl_ = context.useCaratAsControl;
+	utf8_ = context.utf8;
 }
 void Wheelwriter::TypeStream::reset() {
-	buffer_.clear();
+	sequenceLength_ = 0;
+	parameterCount_ = 0;
+	digits_ = 0;
 	typestyle_ = TYPESTYLE_NORMAL; 
 	lineSpacing_ = LINESPACING_ONE;
 	state_ = NORMAL;
+	utf8Count_ = 0;
+	utf8Length_ = 0;
+	codepoint_ = 0;
 }
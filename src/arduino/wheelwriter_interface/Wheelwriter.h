@@ -5,8 +5,18 @@
 //
 #pragma once
 
+#ifdef WHEELWRITER_SIM
+#include "SimUart9Bit.h"
+#else
 #include "uart_9bit/Uart9bit.h"
+#endif
+#include "BusCore.h"
+#include "BusFrameDecoder.h"
+#include "BusTransactionEngine.h"
+#include "PrintwheelTables.h"
+#include "ReadinessModel.h"
 #include <string>
+#include <vector>
 
 namespace wheelwriter {
 
@@ -45,6 +55,43 @@ static const uint8_t ww_command_length[16] = {1, 1, 3, 3,
 																				1, 2, 2, 1,
 																				3, 2, 2, 0};
 
+// Index is command value
+// Milliseconds to wait for each ACK/response before a command fails. Replies 
+// are normally back within a millisecond, but the controller holds back the 
+// response to a reset until the carriage reaches the left stop, 0x0c 
+// queries can wait for motion to finish, and the ACK to a motion command is 
+// held until the previous one starts, which in underline mode takes two 
+// strikes.
+static const uint16_t ww_command_timeout[16] = {100, 2000, 250, 250, 
+                                                250, 250, 250, 100, 
+                                                100, 100, 100, 100,
+                                                1000, 100, 100, 100};
+
+// Mechanism timings for predicting when the typewriter is ready, by model (see
+// ReadinessModel.h). The first entry is used for unknown models. The models
+// haven't been timed separately yet, so they share the same estimates.
+static const ww_timing ww_model_timing[] = {
+//  model                wheel  hammer erase  carriage   platen      spin    margin
+	{UNKNOWN_MODEL,       1200,  40000, 25000, 9000, 70,  9000, 600,  800000, 20000},
+	{WHEELWRITER_3,       1000,  35000, 20000, 8000, 60,  8000, 500,  700000, 5000},
+	{WHEELWRITER_5,       1000,  35000, 20000, 8000, 60,  8000, 500,  700000, 5000},
+	{WHEELWRITER_6,       1000,  35000, 20000, 8000, 60,  8000, 500,  700000, 5000}
+};
+inline const ww_timing& ww_timing_for_model(uint8_t model) {
+	for (unsigned i = 1; i < sizeof(ww_model_timing) / sizeof(ww_model_timing[0]); i++) {
+		if (ww_model_timing[i].model == model) {
+			return ww_model_timing[i];
+		}
+	}
+	return ww_model_timing[0];
+}
+
+// Commands whose reply carries information rather than just an ACK
+inline bool ww_command_is_query(uint8_t command) {
+	return (command == QUERY_MODEL) || (command == RESET) || 
+	       (command == QUERY_WHEEL) || (command == QUERY_STATUS);
+}
+
 static const char ww_command_part_strings[][8] = {
 	"address",
 	"command",
@@ -83,6 +130,41 @@ enum ww_repeat_mode {
 	CENTER = 0x80,
 };
 
+// Bit 0 of the command 0x09 byte is the hammer impression, as set with
+// Code+Q: 0x00 normal, 0x01 heavy on a Wheelwriter 3
+static const uint8_t WW_IMPRESSION_MASK = 0x01;
+
+// Repeat modes (command 0x09) the motor controller carries out itself, by
+// model. In UNDERLINE mode every character typed, spaces included, is 
+// followed by an underscore. CENTER and REPEAT_CHARACTER work from the 
+// margins and keys set on the typewriter, which the interface can't see, so 
+// centering and rules are always done by the driver. impression is the 
+// 0x09 impression bits for each ww_impression_level - a model without 
+// impression control has them all the same.
+struct ww_capabilities {
+	uint8_t model;
+	uint8_t repeatModes;
+	uint8_t impression[IMPRESSION_LEVELS];
+};
+static const ww_capabilities ww_model_capabilities[] = {
+//  model          repeat modes  light normal heavy
+	{UNKNOWN_MODEL, REPEAT_OFF,  {0x00, 0x00, 0x00}},
+	{WHEELWRITER_3, UNDERLINE,   {0x00, 0x00, 0x01}},
+	{WHEELWRITER_5, UNDERLINE,   {0x00, 0x00, 0x01}},
+	{WHEELWRITER_6, UNDERLINE,   {0x00, 0x00, 0x01}}
+};
+inline const ww_capabilities& ww_capabilities_for_model(uint8_t model) {
+	for (unsigned i = 1; i < sizeof(ww_model_capabilities) / sizeof(ww_model_capabilities[0]); i++) {
+		if (ww_model_capabilities[i].model == model) {
+			return ww_model_capabilities[i];
+		}
+	}
+	return ww_model_capabilities[0];
+}
+inline uint8_t ww_repeat_modes_for_model(uint8_t model) {
+	return ww_capabilities_for_model(model).repeatModes;
+}
+
 enum ww_status {
 	NO_STATUS = 0x00,
 	CARRIAGE_MOTION_COMPLETE = 0x04,
@@ -186,6 +268,24 @@ enum ww_linespacing {
 	LINESPACING_THREE = 0x03
 };
 
+// Where typing has got to, saved so that it can carry on from there after
+// something else has used the typewriter (see Wheelwriter::saveContext())
+struct ww_typing_context {
+	int32_t leftMargin;         // Carriage position of the left margin, from where init() left it
+	int32_t topOfPage;          // Platen position of the top of page, likewise
+	int16_t horizontal;         // From the left margin
+	int16_t vertical;           // From the top of page
+	uint32_t strikes;           // Characters typed or erased so far
+	uint16_t charSpace;
+	uint8_t lineSpaceSingle;
+	ww_linespacing lineSpacing;
+	// TypeStream
+	ww_typestyle typestyle;
+	ww_linespacing streamLineSpacing;
+	bool useCaratAsControl;
+	bool utf8;
+};
+
 enum ww_keypress_type {
 	NO_KEYPRESS = 0x00,
 	CHARACTER_KEYPRESS = 0x01,
@@ -198,106 +298,45 @@ enum ww_keypress_type {
 static const uint16_t WW_ADDRESS_BIT = 0x100;
 static const uint8_t WW_MOTOR_CTRL_ADDR = 0x21;
 static const uint8_t WW_PRINTWHEEL_MAX = 0x60;
+// Struck by the typewriter itself in underline mode
+static const uint8_t WW_UNDERSCORE_POSITION = 0x4f;
 static const uint8_t WW_CARRIAGE_ADVANCE_USTEP_MAX = 63;
 static const uint8_t WW_PLATEN_ADVANCE_USTEP_MAX = 127;
+static const uint16_t WW_CARRIAGE_MOVE_USTEP_MAX = 0x7ff;
+// Right stop of the carriage, in microspaces from the left stop
+static const int32_t WW_CARRIAGE_USTEP_MAX = 1320;
 static const uint8_t WW_MAX_VALID_COMMAND = SEND_CODE;
+// Milliseconds to wait for a reply when the command isn't known yet
+static const uint16_t WW_DEFAULT_TIMEOUT = 100;
+// Longest waitReady() will poll the status for
+static const uint16_t WW_WAIT_READY_TIMEOUT = 2000;
+// Milliseconds without typing before service() sends deferred motion
+static const uint16_t WW_SETTLE_DELAY = 100;
+// TypeStream escape sequences - parameters, digits per parameter and the
+// longest sequence that can be held (^[[ and four parameters)
+static const uint8_t WW_CSI_PARAMETERS_MAX = 4;
+static const uint8_t WW_CSI_DIGITS_MAX = 4;
+static const uint8_t WW_ESCAPE_SEQUENCE_MAX = 24;
+// Strikes buffered for a line before it is printed anyway
+static const uint16_t WW_LINE_BUFFER_MAX = 256;
+// Characters remembered on a line for correction - the oldest are forgotten
+static const uint16_t WW_CORRECTION_BUFFER_MAX = 256;
+// Lines and glyphs in a printwheel sample
+static const uint8_t WW_PRINTWHEEL_SAMPLE_LINES = 17;
+static const uint16_t WW_PRINTWHEEL_SAMPLE_GLYPHS = 203;
 
 //------------------------------------------------------------------------------------------------
-// ASCII (ISO 8859-1) to Wheelwriter US printwheel translation table
+// Printwheel translation tables (PrintwheelTables.h) are generated for each keyboard from 
+// wheelwriter_printwheel_mapping.tsv by printwheel_tables.py.
 // The Wheelwriter printwheel code indicates the position of the character on the printwheel. 
 // “a” (code 01) is at the 12 o’clock position of the printwheel. Going counter clockwise, 
 // “n” (code 02) is next character on the printwheel followed by “r” (code 03), “m” (code 04),
 // “c” (code 05), “s” (code 06), “d” (code 07), “h” (code 08), and so on.
 //------------------------------------------------------------------------------------------------
-static const char ascii2UsPrintwheelTable[2][256] = { 
-// US 001-008
-// col: 00    01    02    03    04    05    06    07    08    09    0A    0B    0C    0D    0E    0F    row:
-//      NUL   SOH   STX   ETX   EOT   ENQ   ACK   BEL   BS    HT    LF    VT    FF    CR    SO    SI
-			{0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 00
-//      DLE   DC1   DC2   DC3   DC4   NAK   SYN   ETB   CAN   EM    SUB   ESC   FS    GS    RS    US
-			 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 10
-//      SP     !     "     #     $     %     &     '     (     )     *     +     ,     -     .     /
-			 0x00, 0x49, 0x4b, 0x38, 0x37, 0x39, 0x3f, 0x4c, 0x23, 0x16, 0x36, 0x3b, 0x0c, 0x0e, 0x57, 0x28, // 20
-//       0     1     2     3     4     5     6     7     8     9     :     ;     <     =     >     ?
-			 0x30, 0x2e, 0x2f, 0x2c, 0x32, 0x31, 0x33, 0x35, 0x34, 0x2a ,0x4e, 0x50, 0x00, 0x4d, 0x00, 0x4a, // 30
-//       @     A     B     C     D     E     F     G     H     I     J     K     L     M     N     O
-			 0x3d, 0x20, 0x12, 0x1b, 0x1d, 0x1e, 0x11, 0x0f, 0x14, 0x1F, 0x21, 0x2b, 0x18, 0x24, 0x1a, 0x22, // 40
-//       P     Q     R     S     T     U     V     W     X     Y     Z     [     \     ]     ^     _   
-			 0x15, 0x3e, 0x17, 0x19, 0x1c, 0x10, 0x0d, 0x29, 0x2d, 0x26, 0x13, 0x41, 0x00, 0x40, 0x00, 0x4f, // 50
-//       `     a     b     c     d     e     f     g     h     i     j     k     l     m     n     o
-			 0x00, 0x01, 0x59, 0x05, 0x07, 0x60, 0x0a, 0x5a, 0x08, 0x5d, 0x56, 0x0b, 0x09, 0x04, 0x02, 0x5f, // 60
-//       p     q     r     s     t     u     v     w     x     y     z     {     |     }     ~    DEL  
-			 0x5c, 0x52, 0x03, 0x06, 0x5e, 0x5b, 0x53, 0x55, 0x51, 0x58, 0x54, 0x00, 0x00, 0x00, 0x00, 0x00, // 70
-//     
-			 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 80      
-//     
-			 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 90      
-//                   ¢                             §                                                  
-			 0x00, 0x00, 0x3A, 0x00, 0x00, 0x00, 0x00, 0x45, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // A0      
-//       °     ±     ²     ³                 ¶                                   ¼     ½              
-			 0x44, 0x3C, 0x43, 0x42, 0x00, 0x00, 0x46, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0x47, 0x00, 0x00, // B0
-//     
-			 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // C0 
-//     
-			 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // E0 
-//     
-			 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // D0 
-//     
-			 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},// F0 
-
-// ASCII 103
-// col: 00    01    02    03    04    05    06    07    08    09    0A    0B    0C    0D    0E    0F    row:
-//      NUL   SOH   STX   ETX   EOT   ENQ   ACK   BEL   BS    HT    LF    VT    FF    CR    SO    SI
-			{0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 00
-//      DLE   DC1   DC2   DC3   DC4   NAK   SYN   ETB   CAN   EM    SUB   ESC   FS    GS    RS    US
-			 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 10
-//      SP     !     "     #     $     %     &     '     (     )     *     +     ,     -     .     /
-			 0x00, 0x49, 0x4b, 0x38, 0x37, 0x39, 0x3f, 0x4c, 0x23, 0x16, 0x36, 0x3b, 0x0c, 0x0e, 0x57, 0x28, // 20
-//       0     1     2     3     4     5     6     7     8     9     :     ;     <     =     >     ?
-			 0x30, 0x2e, 0x2f, 0x2c, 0x32, 0x31, 0x33, 0x35, 0x34, 0x2a ,0x4e, 0x50, 0x45, 0x4d, 0x46, 0x4a, // 30
-//       @     A     B     C     D     E     F     G     H     I     J     K     L     M     N     O
-			 0x3d, 0x20, 0x12, 0x1b, 0x1d, 0x1e, 0x11, 0x0f, 0x14, 0x1F, 0x21, 0x2b, 0x18, 0x24, 0x1a, 0x22, // 40
-//       P     Q     R     S     T     U     V     W     X     Y     Z     [     \     ]     ^     _   
-			 0x15, 0x3e, 0x17, 0x19, 0x1c, 0x10, 0x0d, 0x29, 0x2d, 0x26, 0x13, 0x41, 0x42, 0x40, 0x3a, 0x4f, // 50
-//       `     a     b     c     d     e     f     g     h     i     j     k     l     m     n     o
-			 0x3c, 0x01, 0x59, 0x05, 0x07, 0x60, 0x0a, 0x5a, 0x08, 0x5d, 0x56, 0x0b, 0x09, 0x04, 0x02, 0x5f, // 60
-//       p     q     r     s     t     u     v     w     x     y     z     {     |     }     ~    DEL  
-			 0x5c, 0x52, 0x03, 0x06, 0x5e, 0x5b, 0x53, 0x55, 0x51, 0x58, 0x54, 0x48, 0x43, 0x47, 0x44, 0x00, // 70
-//     
-			 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 80      
-//     
-			 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 90      
-//                   ¢                             §                                                  
-			 0x00, 0x00, 0x3A, 0x00, 0x00, 0x00, 0x00, 0x45, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // A0      
-//       °     ±     ²     ³                 ¶                                   ¼     ½              
-			 0x44, 0x3C, 0x43, 0x42, 0x00, 0x00, 0x46, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0x47, 0x00, 0x00, // B0
-//     
-			 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // C0 
-//     
-			 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // E0 
-//     
-			 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // D0 
-//     
-			 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00} // F0
-};
-
-static const char usPrintwheel2AsciiTable[97] = {
-// SP    a     n     r     m     c     s     d     h     l     f     k     ,     V     _     G
-	0x20, 0x61, 0x6E, 0x72, 0x6D, 0x63, 0x73, 0x64, 0x68, 0x6C, 0x66, 0x6B, 0x2C, 0x56, 0x2D, 0x47,
-// U     F     B     Z     H     P     )     R     L     S     N     C     T     D     E     I   
-	0x55, 0x46, 0x42, 0x5A, 0x48, 0x50, 0x29, 0x52, 0x4C, 0x53, 0x4E, 0x43, 0x54, 0x44, 0x45, 0x49,
-// A     J     O     (     M     .     Y     ,     /     W     9     K     3     X     1     2
-	0x41, 0x4A, 0x4F, 0x28, 0x4D, 0x2E, 0x59, 0x2C, 0x2F, 0x57, 0x39, 0x4B, 0x33, 0x58, 0x31, 0x32,
-// 0     5     4     6     8     7     *     $     #     %     ¢     +     ±     @     Q     &
-	0x30, 0x35, 0x34, 0x36, 0x38, 0x37, 0x2A, 0x24, 0x23, 0x25, 0xA2, 0x2B, 0xB1, 0x40, 0x51, 0x26,
-// ]     [     ³     ²     °     §     ¶     ½     ¼     !     ?     "     '     =     :     -
-	0x5D, 0x5B, 0xB3, 0xB2, 0xB0, 0xA7, 0xB6, 0xBD, 0xBC, 0x21, 0x3F, 0x22, 0x27, 0x3D, 0x3A, 0x5F,
-// ;     x     q     v     z     w     j     .     y     b     g     u     p     i     t     o     e   
-	0x3B, 0x78, 0x71, 0x76, 0x7A, 0x77, 0x6A, 0x2E, 0x79, 0x62, 0x67, 0x75, 0x70, 0x69, 0x74, 0x6F, 0x65};
 
 class Wheelwriter {
 public:
-	Wheelwriter() : init_(0), typeStream(*this) {}
+	Wheelwriter() : typeStream(*this), init_(0) {}
 	void init(Uart9Bit* uart, uint16_t charSpace=10, uint8_t lineSpace=16) {
 		uart_ = uart;
 		model_ = UNKNOWN_MODEL;
@@ -308,19 +347,104 @@ public:
 		lineSpacing_ = LINESPACING_ONE;
 		defaultAddress_ = WW_MOTOR_CTRL_ADDR;
 		horizontalMicrospaces_ = 0;
+		carriageMicrospaces_ = 0;
+		verticalMicrospaces_ = 0;
+		leftMarginMicrospaces_ = 0;
+		strikes_ = 0;
+		topOfPageMicrospaces_ = 0;
+		pendingPlatenMicrospaces_ = 0;
+		pendingCharacter_ = 0;
+		motionTime_ = 0;
+		bidirectional_ = false;
+		ordered_ = false;
+		emphasisPasses_ = true;
+		impressionControl_ = false;
+		passLine_ = false;
+		lineBuffer_.clear();
+		corrections_.clear();
+		pendingErases_.clear();
+		overwrite_ = false;
+		wheelPosition_ = 0;
+		repeatMode_ = REPEAT_OFF;
+		hardwareRepeatModes_ = true;
+		async_ = false;
+		busCore_ = NULL;
+		engine_.init(uart, ww_command_length, ww_command_timeout, WW_MAX_VALID_COMMAND, QUERY_STATUS);
+		frames_.init(ww_command_length, WW_MAX_VALID_COMMAND);
+		readiness_ = ReadinessModel();
+		readiness_.setTiming(ww_timing_for_model(model_));
+		engine_.setReadiness(&readiness_);
 		init_ = 1;
 	}
 	uint8_t sendCommand(ww_command command);
 	uint8_t sendCommand(ww_command command, uint8_t data);
 	uint8_t sendCommand(ww_command command, uint8_t data1, uint8_t data2);
 	uint16_t sendCommand(uint8_t address, uint8_t command, uint8_t data1, uint8_t data2, uint8_t& error, uint8_t& failIndex, int ignoreErrors=0);
-	uint16_t _sendByte(uint16_t byte);
 	uint16_t _sendCommand(uint8_t address, uint8_t command, uint8_t data1, uint8_t data2, uint8_t& error, uint8_t& failIndex, int ignoreErrors=0);
 	void _printCommandError(uint8_t error, uint8_t failIndex, uint16_t response);
+	// Queues a command on the transaction engine without waiting for it. The 
+	// status is queried first, as in sendCommand(). Blocks only while the queue 
+	// is full. A timeout of 0 uses the command timeout. Returns the transaction handle.
+	uint16_t sendCommandAsync(uint8_t address, uint8_t command, uint8_t data1, uint8_t data2, int ignoreErrors=0,
+	                          BusTransactionCallback callback=NULL, void* context=NULL, bool haltOnError=false,
+	                          uint16_t timeout=0);
+	// Milliseconds to wait for each ACK/response to a command type
+	uint16_t getCommandTimeout(uint8_t command);
+	void setCommandTimeout(uint8_t command, uint16_t timeout);
+	// In async mode, commands without a response (typing, motion) are queued and
+	// return immediately. Queries wait for everything queued ahead of them.
+	void setAsync(bool async);
+	bool async();
+	// Hands the UART and the running of commands over to core, whose run() is
+	// then called over and over on the second core (or inline - see BusCore).
+	// Call before the second core is started. Commands are still submitted,
+	// and their callbacks called, on this core.
+	void setBusCore(BusCore* core);
+	// Steps queued transactions without blocking - call regularly. Also sends
+	// deferred motion once nothing has been typed for WW_SETTLE_DELAY ms.
+	void service();
+	// Sends deferred motion, then waits for all queued transactions to complete
+	void flush();
+	// Transactions queued or still running
+	uint8_t pending();
+	// Sends the deferred character and carriage/platen moves, if any
+	void settle();
+	// In bidirectional mode a line is buffered until the next platen move, then
+	// printed from whichever end is nearer the carriage, so the carriage doesn't
+	// go back to the margin between lines
+	void setBidirectional(bool bidirectional);
+	bool bidirectional();
+	// Buffers each line and strikes it in the order that keeps wheel rotation
+	// and carriage travel down, rather than in reading order
+	void setStrikeOrdering(bool ordered);
+	bool strikeOrdering();
+	// Once a line has bold or struck underlines, the rest of it is buffered and
+	// printed in passes: the glyphs, then the bold strikes offset by a
+	// microspace, then the underlines. Otherwise each emphasised glyph is
+	// struck two or three times where it stands, with a move in between.
+	void setEmphasisPasses(bool emphasisPasses);
+	bool emphasisPasses();
+	// Strikes each glyph at the impression its printwheel's impression table
+	// asks for, on models with impression control. From the first glyph on a
+	// line that needs another impression, the rest of the line is buffered and
+	// struck a level at a time, starting with the current one, so the
+	// impression changes at most once per level per line.
+	void setImpressionControl(bool impressionControl);
+	bool impressionControl();
+	// Takes the next frame sent to the motor controller - by the keyboard, or
+	// anything else on the bus - and returns its length, or 0 if there isn't one
+	// and blocking is 0. Never waits part way through a frame.
 	uint8_t readCommand(uint8_t blocking=1, uint8_t verbose=0);
 	ww_keypress_type readKeypress(char& ascii, uint8_t blocking=1, uint8_t verbose=0);
-	void waitReady(ww_command command);
+	// Decodes whatever has come in from the bus into frames, without waiting.
+	// Nothing is read while commands are queued.
+	void pollBus();
+	BusFrameDecoder& frameDecoder();
+	// Polls the status until the typewriter is ready. Returns false if it is 
+	// still busy after WW_WAIT_READY_TIMEOUT ms or doesn't answer.
+	bool waitReady(ww_command command);
 	void readFlush(bool verbose=0);
+	// Whether a frame from the bus is waiting to be read
 	bool available();
 
 	ww_model queryModel();
@@ -331,28 +455,70 @@ public:
 	void typeAsciiString(char* string, uint8_t advanceUsteps, ww_typestyle style=TYPESTYLE_NORMAL, bool newLine=false);
 	void typeAsciiString(char* string, ww_typestyle style=TYPESTYLE_NORMAL, bool newLine=false);
 	void typeAsciiLine(char* string, ww_typestyle style=TYPESTYLE_NORMAL);
+	// Types a string centered on a line width characters wide, starting from the left margin
+	void typeCentered(char* string, uint16_t width, ww_typestyle style=TYPESTYLE_NORMAL, bool newLine=true);
+	// Types a rule of length characters
+	void typeRule(char ascii, uint16_t length, bool newLine=true);
 	void typeCharacterInPlace(uint8_t wheelPosition, ww_typestyle style=TYPESTYLE_NORMAL);
 	void typeCharacter(uint8_t wheelPosition, uint8_t advanceUsteps, ww_typestyle style=TYPESTYLE_NORMAL);
 	void typeCharacter(uint8_t wheelPosition, ww_typestyle style=TYPESTYLE_NORMAL);
 	void eraseCharacter(uint8_t wheelPosition, uint8_t advanceUsteps, ww_typestyle style=TYPESTYLE_NORMAL);
+	// Moves back a number of characters. With erase, whatever was typed there
+	// on this line is lifted off. Erases are held and sent by settle() in one
+	// sweep, so deleting a word costs one pass of the carriage.
+	void backspace(uint16_t characters=1, bool erase=false);
+	// In overwrite mode, a character typed over one already on the line
+	// (spaces included) lifts the old one off first, rather than overstriking it
+	void setOverwrite(bool overwrite);
+	bool overwrite();
 	void movePlaten(int8_t usteps);
 	void movePlaten(uint8_t usteps, ww_platen_direction direction);
 	void moveCarriage(int16_t usteps);
 	void moveCarriage(uint16_t usteps, ww_carriage_direction direction);
 	void moveCarriageSpaces(int16_t spaces);
+	// Moves to a position from the left margin and the top of the page
+	void moveCarriageTo(int16_t x);
+	void movePlatenTo(int16_t y);
 	void carriageReturn();
 	void lineFeed(ww_platen_direction direction=PLATEN_DIRECTION_UP);
 	void spinWheel();
 	ww_printwheel queryPrintwheel();
 	void setRepeatMode(ww_repeat_mode repeatMode);
+	// Turns off any repeat mode set for the last characters typed
+	void clearRepeatMode();
+	// Whether the typewriter handles a repeat mode itself (see ww_model_capabilities)
+	bool supportsRepeatMode(ww_repeat_mode repeatMode);
+	// Allows styles to use the typewriter's repeat modes, if supported. Otherwise
+	// every underline is struck separately.
+	void setHardwareRepeatModes(bool enable);
 	ww_status queryStatus();
 	// ww_operation queryOperation();
 	void sendCode(ww_keycode code);
 
+	// ISO 8859-1 to the printwheel position for the keyboard, 0 if it isn't on the wheel
 	char ascii2Printwheel(char ascii);
+	// Unicode to the printwheel position, 0 if it isn't on the wheel
+	uint8_t unicode2Printwheel(uint16_t codepoint);
+	// Printwheel position to Unicode, or ISO 8859-1 (0 if there is no ISO 8859-1 equivalent)
+	uint16_t printwheel2Unicode(uint8_t wheelPosition);
+	char printwheel2Ascii(uint8_t wheelPosition);
+	// Selects the translation tables for a keyboard (see ww_keyboard_table_index).
+	// Keyboards without tables use the US ones.
 	void setKeyboard(uint16_t keyboard);
 	int16_t horizontalMicrospaces();
 	void setLeftMargin();
+	// Platen position, down the page from where setTopOfPage() was last called
+	int16_t verticalMicrospaces();
+	void setTopOfPage();
+	// Saves the position, margin, spacing and TypeStream style, between characters
+	void saveContext(ww_typing_context& context);
+	// Goes back to a saved context: the carriage returns to the saved margin and
+	// column, and the platen stays where it is (moving on to a fresh line if
+	// anything has been typed on the current one since the save), which becomes
+	// the saved line of the saved page.
+	void restoreContext(const ww_typing_context& context);
+	uint16_t charSpace();
+	uint8_t lineSpace();
 	void setCharSpace(uint16_t usteps);
 	// Directly sets the line spacing
 	void setLineSpace(uint8_t usteps);
@@ -374,12 +540,17 @@ public:
 
 	// Types a 10-length repeating pattern of characters
 	void bufferTest(uint16_t numChars, uint8_t charsPerLine);
+	// Types character index of the buffer test, and the line end after it
+	void bufferTestCharacter(uint16_t index, uint16_t numChars, uint8_t charsPerLine);
 	// Types Lorem ipsum in a circle
 	void circleTest();
 	// Types all the characters in the printwheel (US keyboard)
 	void characterTest(wheelwriter::ww_typestyle style=TYPESTYLE_NORMAL);
 	// Generates a formatted printwheel sample
 	void printwheelSample(uint8_t plusPosition, uint8_t underscorePosition);
+	// Types one line of the printwheel sample (of WW_PRINTWHEEL_SAMPLE_LINES).
+	// Returns the number of glyphs struck.
+	uint8_t printwheelSampleLine(uint8_t line, uint8_t plusPosition, uint8_t underscorePosition);
 	// Queries the typewriter and generates a JSON
 	void queryToJson(std::string& json);
 	// Read a line from the typewriter 
@@ -390,39 +561,175 @@ public:
 
 	class TypeStream {
 	public:
-		TypeStream(Wheelwriter& typewriter) : typewriter_(typewriter), useCaratAsControl_(true) {
+		TypeStream(Wheelwriter& typewriter) : typewriter_(typewriter), useCaratAsControl_(true), utf8_(true) {
 			reset();
 		}
 		int operator<<(char inByte) {
 			return type(inByte);
 		}
+		// Types text, and carries out escape sequences: ^D or EOT ends the
+		// stream (returns 0), ESC[...m (or ^[[...m) sets the style and line
+		// spacing, and ESC[ H, f, A, B, C, D, `, G and d move the carriage and
+		// platen, to rows and columns counted from 1 at the top of the page and
+		// the left margin. BS moves back a character and DEL erases the one
+		// before. Anything else is typed as it came.
 		int type(char inByte);
 		void reset();
 		void setUseCaratAsControl(bool useCaratAsControl) {
 			useCaratAsControl_ = useCaratAsControl;
 		}
+		// Text is decoded as UTF-8, and bytes that aren't part of a valid
+		// sequence are taken as ISO 8859-1. Otherwise every byte is ISO 8859-1.
+		void setUtf8(bool utf8) {
+			utf8_ = utf8;
+			utf8Length_ = 0;
+		}
+		// Whether the stream is part way through an escape or UTF-8 sequence
+		bool inSequence() {
+			return (state_ != NORMAL) || utf8Length_;
+		}
+		// The style and settings, for Wheelwriter::saveContext()
+		void saveContext(ww_typing_context& context);
+		// Drops any sequence in progress
+		void restoreContext(const ww_typing_context& context);
 	private:
-		void flushBuffer();
-		int parseEscape(const std::string& buffer, wheelwriter::ww_typestyle& typestyle, wheelwriter::ww_linespacing& lineSpacing);
-		size_t digitOffset(const std::string& buffer);
+		enum State : uint8_t {
+			NORMAL=0,
+			CARAT,
+			ESCAPE,
+			CSI,
+			STATES
+		};
+		enum ByteClass : uint8_t {
+			BYTE_TEXT,
+			BYTE_EOT,        // 0x04
+			BYTE_NEWLINE,    // 0x0a
+			BYTE_ESCAPE,     // 0x1b
+			BYTE_CARAT,      // ^
+			BYTE_BRACKET,    // [
+			BYTE_DIGIT,
+			BYTE_SEPARATOR,  // ;
+			BYTE_D,          // d, D - EOT after ^, or a final byte
+			BYTE_FINAL,      // Any other final byte (0x40-0x7e)
+			BYTE_BACKSPACE,  // 0x08
+			BYTE_DELETE,     // 0x7f
+			BYTE_CLASSES
+		};
+		enum Action : uint8_t {
+			ACTION_TEXT,
+			ACTION_EOT,
+			ACTION_NEWLINE,
+			ACTION_CARAT,      // Starts a sequence, if ^ is a control character
+			ACTION_START,
+			ACTION_STORE,
+			ACTION_DIGIT,
+			ACTION_SEPARATOR,
+			ACTION_FINAL,
+			ACTION_BACKSPACE,
+			ACTION_DELETE,
+			ACTION_INVALID     // Types the sequence so far as text
+		};
+		struct Transition {
+			Action action;
+			State next;
+		};
+		struct SgrParameter {
+			uint8_t value;
+			uint8_t keep;
+			uint8_t set;
+			int8_t lineSpacing;  // -1 leaves it as it is
+		};
+		static const Transition transitions_[STATES][BYTE_CLASSES];
+		static const SgrParameter sgrParameters_[];
+
+		static ByteClass classify(uint8_t inByte);
+		// Carries out a CSI sequence. Returns false if it isn't supported.
+		bool dispatch(char final, uint8_t count);
+		bool selectGraphicRendition(uint8_t count);
+		// Types the sequence so far as text
+		void flushSequence();
+		void typeText(char inByte);
+		// Decodes a byte of text, typing each character as it completes. A
+		// sequence can be split across calls.
+		void decodeUtf8(uint8_t inByte);
+		// Types the bytes of a sequence that turned out not to be UTF-8
+		void flushUtf8();
+		void typeCodepoint(uint32_t codepoint);
 
 		Wheelwriter& typewriter_;
 		ww_typestyle typestyle_;
 		ww_linespacing lineSpacing_;
-		std::string buffer_;
-		enum State {
-			NORMAL=1,
-			CARAT,
-			ESCAPE,
-			CSI
-		} state_;
+		State state_;
+		// The escape sequence so far, and its parameters
+		char sequence_[WW_ESCAPE_SEQUENCE_MAX];
+		uint8_t sequenceLength_;
+		uint16_t parameters_[WW_CSI_PARAMETERS_MAX];
+		uint8_t parameterCount_;  // Separators so far
+		uint8_t digits_;          // Digits in the current parameter
 		bool useCaratAsControl_;
+		bool utf8_;
+		// The UTF-8 sequence so far
+		uint8_t utf8Bytes_[4];
+		uint8_t utf8Count_;
+		uint8_t utf8Length_;
+		uint32_t codepoint_;
 	} typeStream;
 
 private:
+	uint16_t _submit(uint8_t address, uint8_t command, uint8_t data1, uint8_t data2, uint8_t flags,
+	                 BusTransactionCallback callback, void* context, uint16_t timeout=0);
+	uint8_t _sendCommandDefault(ww_command command, uint8_t data1, uint8_t data2);
+	// Sends without settling first - for the deferred motion itself
+	uint8_t _sendCommandNow(ww_command command, uint8_t data1, uint8_t data2);
+	void _deferMotion();
+	// Whether strikes go into the line buffer rather than straight to the typewriter
+	bool _lineBuffered();
+	// Impression bits (command 0x09) to strike a glyph with - the current ones
+	// if impression control is off
+	uint8_t _impression(uint8_t wheelPosition);
+	// Buffers the rest of the line if a glyph needs a change of impression
+	void _passesForImpression(uint8_t wheelPosition);
+	// Strikes in place, or adds the strike to the line buffer in a pass
+	void _strike(uint8_t wheelPosition, uint8_t pass=LINE_PASS_GLYPH);
+	// Prints the line buffer a pass at a time, each starting from the end
+	// nearer the carriage, or in the cheapest order found if strike ordering is on
+	void _printLine();
+	// Estimated time from the current carriage and wheel position to a strike
+	uint32_t _strikeCost(int16_t fromX, uint8_t fromWheel, int16_t x, uint8_t wheelPosition);
+	// Orders strikes [begin, end) of the line buffer greedily from x and wheel,
+	// always taking the cheapest next group of strikes. Appends to order and
+	// returns the estimated time.
+	uint32_t _orderLineGreedy(std::vector<uint16_t>& order, size_t begin, size_t end, int16_t x, uint8_t wheel);
+	// Orders strikes [begin, end) of the line buffer as a sweep in one direction
+	uint32_t _orderLineSweep(std::vector<uint16_t>& order, size_t begin, size_t end, int16_t x, uint8_t wheel,
+	                         bool reverse);
+	// Sends carriage moves to get the carriage to x
+	void _moveCarriageTo(int16_t x);
+	// Sends the deferred platen moves
+	void _movePlatenPending();
+	// Records a character typed at the current position for correction. In
+	// overwrite mode, queues erases for whatever was there first.
+	void _remember(uint8_t wheelPosition, ww_typestyle style);
+	// Queues erases for the characters remembered between from and to
+	void _eraseRange(int16_t from, int16_t to);
+	// Sends the queued erases in a sweep from the end nearer the carriage
+	void _sendErases();
+	// Sets or clears the typewriter's underline mode for a style. Returns true
+	// if the typewriter is underlining.
+	bool _syncUnderline(ww_typestyle style);
+	static void _asyncCommandCallback(const BusTransaction& transaction, void* context);
+	// Takes the next word off the bus, from the bus core if there is one
+	bool _takeWord(uint16_t& word, uint32_t& timestamp);
+
 	uint init_;
 	Uart9Bit* uart_;
-	uint16_t bufferIn_[5];
+	BusTransactionEngine engine_;
+	BusCore* busCore_;
+	ReadinessModel readiness_;
+	bool async_;
+	BusFrameDecoder frames_;
+	// Last frame read by readCommand()
+	BusFrame frameIn_;
 	uint8_t defaultAddress_;
 	ww_model model_;
 	ww_printwheel wheel_;
@@ -432,7 +739,61 @@ private:
 	uint8_t lineSpace_;
 	uint8_t lineSpaceSingle_;
 	ww_linespacing lineSpacing_;
+	// Carriage and platen moves are deferred and merged until something is
+	// struck, so runs of spaces, trailing blanks and blank lines cost at most
+	// one move each way. The last character is held back too, so the space
+	// after it can go in its advance field. horizontalMicrospaces_ is where
+	// the next character goes, carriageMicrospaces_ where the carriage is.
 	int16_t horizontalMicrospaces_;
+	int16_t carriageMicrospaces_;
+	int16_t verticalMicrospaces_;
+	// Where the left margin and top of page are, from where init() left the
+	// carriage and platen, so that a saved context can find them again
+	int32_t leftMarginMicrospaces_;
+	int32_t topOfPageMicrospaces_;
+	// Characters typed or erased, so that a saved context can tell whether
+	// anything has been put on the line since
+	uint32_t strikes_;
+	int16_t pendingPlatenMicrospaces_;
+	uint8_t pendingCharacter_;
+	unsigned long motionTime_;
+	// A strike at a position on the line, for buffered printing. A line is
+	// printed a pass at a time, in this order.
+	enum LinePass : uint8_t {
+		LINE_PASS_GLYPH = 0,
+		LINE_PASS_BOLD,
+		LINE_PASS_UNDERLINE
+	};
+	struct LineStrike {
+		int16_t x;
+		uint8_t wheelPosition;
+		uint8_t pass;
+		uint8_t impression;
+	};
+	bool bidirectional_;
+	bool ordered_;
+	bool emphasisPasses_;
+	bool impressionControl_;
+	// The line being typed has emphasis or impression changes, and is
+	// buffered until it is printed in passes
+	bool passLine_;
+	std::vector<LineStrike> lineBuffer_;
+	// Characters typed on the current line, with where and how they were
+	// struck, so they can be erased. Forgotten when the platen moves.
+	struct Correction {
+		int16_t x;
+		uint8_t wheelPosition;
+		uint8_t style;
+	};
+	std::vector<Correction> corrections_;
+	// Erases not sent yet. Anything struck sends them first.
+	std::vector<LineStrike> pendingErases_;
+	bool overwrite_;
+	// Last position struck, for estimating wheel rotation
+	uint8_t wheelPosition_;
+	// Repeat mode last set on the typewriter
+	uint8_t repeatMode_;
+	bool hardwareRepeatModes_;
 
 	char stringBuffer[256];
 };
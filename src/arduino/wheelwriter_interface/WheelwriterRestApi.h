@@ -7,20 +7,77 @@
 #include <WiFiNINA.h>
 
 #include "PicoRest.h"
+#include "PrintJobQueue.h"
 #include "Wheelwriter.h"
 #include "utility.h"
 
 
 class WheelwriterRestApi : public PicoRest::PicoRestApi {
 public:
-  WheelwriterRestApi(WiFiServer& server, wheelwriter::Wheelwriter& typewriter) : PicoRest::PicoRestApi(server), typewriter_(typewriter) {}
+  WheelwriterRestApi(WiFiServer& server, wheelwriter::Wheelwriter& typewriter) : PicoRest::PicoRestApi(server), typewriter_(typewriter), jobs_(typewriter) {}
+  // Types the print jobs in the background - call from the main loop
+  void serviceJobs() {
+    jobs_.service();
+  }
+  // Hold the print jobs while the serial interface uses the typewriter. The 
+  // running job is preempted at the end of its line and resumes afterwards.
+  void suspendJobs() {
+    jobs_.suspend();
+  }
+  void releaseJobs() {
+    jobs_.release();
+  }
+  // /type, /bufferTest and /printwheelSample queue a job and answer 202 
+  // Accepted with it straight away, or 503 if the queue is full. The job is 
+  // followed with GET /jobs/<id>, and stopped with POST /jobs/<id>/cancel, 
+  // /pause and /resume. ?priority=bulk|normal|urgent sets the job's priority
+  // (normal by default) - a job preempts one of lower priority at the end of 
+  // its line.
   void handlePostRequest(WiFiClient& client, PicoRest::HttpRequest& request) override {
-    if (request.path == "/bufferTest") {
-      ParameterString parameters(request.content);
+    wheelwriter::print_job_priority priority;
+    if (!parsePriority(request.path, priority)) {
+      sendGenericResponse(client, PicoRest::HttpResponse::StatusCode::BAD_REQUEST);
+      return;
+    }
+    std::string_view action;
+    uint16_t jobId = parseJobPath(request.path, action);
+    if (jobId) {
+      const wheelwriter::PrintJob* job = jobs_.find(jobId);
+      if (!job) {
+        sendGenericResponse(client, PicoRest::HttpResponse::StatusCode::NOT_FOUND);
+        return;
+      }
+      bool applied;
+      if (action == "cancel") {
+        applied = jobs_.cancel(jobId);
+      }
+      else if (action == "pause") {
+        applied = jobs_.pause(jobId);
+      }
+      else if (action == "resume") {
+        applied = jobs_.resume(jobId);
+      }
+      else {
+        sendGenericResponse(client, PicoRest::HttpResponse::StatusCode::NOT_FOUND);
+        return;
+      }
+      sendJob(client, applied ? PicoRest::HttpResponse::StatusCode::OK : PicoRest::HttpResponse::StatusCode::CONFLICT, 
+              jobs_.find(jobId));
+    }
+    else if (request.path == "/bufferTest") {
+      ParameterString parameters(std::string(request.content));
       uint16_t numChars = parameters.getParameterInt(0, 10);
       uint8_t charsPerLine = parameters.getParameterInt(1, 80);
-      typewriter_.bufferTest(numChars, charsPerLine);
-      sendGenericResponse(client, PicoRest::HttpResponse::StatusCode::OK);
+      if (!charsPerLine) {
+        sendGenericResponse(client, PicoRest::HttpResponse::StatusCode::BAD_REQUEST);
+        return;
+      }
+      sendSubmitted(client, jobs_.submitBufferTest(numChars, charsPerLine, priority));
+    }
+    else if (jobs_.active() && ((request.path == "/characterTest") || (request.path == "/circleTest") || 
+                                (request.path == "/readLine"))) {
+      // These still run in the handler, and would be mixed in with the job
+      sendGenericResponse(client, PicoRest::HttpResponse::StatusCode::SERVICE_UNAVAILABLE);
     }
     else if (request.path == "/characterTest") {
       wheelwriter::ww_typestyle typestyle = wheelwriter::TYPESTYLE_NORMAL;
@@ -38,67 +95,138 @@ public:
       sendGenericResponse(client, PicoRest::HttpResponse::StatusCode::OK);
     }
     else if (request.path == "/printwheelSample") {
-      ParameterString parameters(request.content);
+      ParameterString parameters(std::string(request.content));
       uint8_t plusPosition = parameters.getParameterInt(0, 0x3b);
       uint8_t underscorePosition = parameters.getParameterInt(1, 0x4f);
-      typewriter_.printwheelSample(plusPosition, underscorePosition);
-      sendGenericResponse(client, PicoRest::HttpResponse::StatusCode::OK);
+      sendSubmitted(client, jobs_.submitPrintwheelSample(plusPosition, underscorePosition, priority));
     }
     else if (request.path == "/query") {
       std::string json;
       typewriter_.queryToJson(json);
-      PicoRest::HttpResponse response(PicoRest::HttpResponse::StatusCode::OK);
-      client.println(response.header().c_str());
-      client.println(json.c_str());
+      sendResponse(client, PicoRest::HttpResponse::StatusCode::OK, json);
     }
     else if (request.path == "/readLine") {
-      ParameterString parameters(request.content);
+      ParameterString parameters(std::string(request.content));
       uint32_t timeout = parameters.getParameterInt(0, 0);
       bool corrected = parameters.getParameterInt(1, true);
       std::string line;
       typewriter_.readLine(line, timeout, corrected);
-      PicoRest::HttpResponse response(PicoRest::HttpResponse::StatusCode::OK);
-      client.println(response.header().c_str());
-      client.println(line.c_str());
+      sendResponse(client, PicoRest::HttpResponse::StatusCode::OK, line);
     }
     else if (request.path == "/type") {
-      typewriter_.readFlush();
-      typewriter_.setSpaceForWheel();
-      // typewriter_.setKeyboard(keyboard);
-      typewriter_.setLeftMargin();
-
-      typewriter_.typeStream.reset();
-      typewriter_.typeStream.setUseCaratAsControl(true);
-
-      for (int i = 0; i < request.content.length(); i++) {
-        if (!(typewriter_.typeStream << request.content[i])) {
-          break;
-        }
+      sendSubmitted(client, jobs_.submitText(std::string(request.content), priority));
+    }
+    else {
+      sendGenericResponse(client, PicoRest::HttpResponse::StatusCode::NOT_FOUND);
+    }
+  }
+  // GET /jobs lists the jobs held, /jobs/<id> gives one: its state, the 
+  // characters and lines done and in total, and the seconds elapsed and to go
+  void handleGetRequest(WiFiClient& client, PicoRest::HttpRequest& request) override {
+    std::string_view action;
+    uint16_t jobId = parseJobPath(request.path, action);
+    if (request.path == "/jobs") {
+      std::string json;
+      jobs_.toJson(json);
+      sendResponse(client, PicoRest::HttpResponse::StatusCode::OK, json);
+    }
+    else if (jobId && action.empty()) {
+      const wheelwriter::PrintJob* job = jobs_.find(jobId);
+      if (job) {
+        sendJob(client, PicoRest::HttpResponse::StatusCode::OK, job);
+      }
+      else {
+        sendGenericResponse(client, PicoRest::HttpResponse::StatusCode::NOT_FOUND);
       }
-      sendGenericResponse(client, PicoRest::HttpResponse::StatusCode::OK);
     }
     else {
+      PicoRest::PicoRestApi::handleGetRequest(client, request);
+    }
+  }
+  // DELETE /jobs/<id> cancels the job
+  void handleDeleteRequest(WiFiClient& client, PicoRest::HttpRequest& request) override {
+    std::string_view action;
+    uint16_t jobId = parseJobPath(request.path, action);
+    if (!jobId || !action.empty() || !jobs_.find(jobId)) {
       sendGenericResponse(client, PicoRest::HttpResponse::StatusCode::NOT_FOUND);
+      return;
     }
+    bool cancelled = jobs_.cancel(jobId);
+    sendJob(client, cancelled ? PicoRest::HttpResponse::StatusCode::OK : PicoRest::HttpResponse::StatusCode::CONFLICT, 
+            jobs_.find(jobId));
   }
   void sendDefaultWebpage(WiFiClient& client) override {
-    // HTTP response header
-    client.println("HTTP/1.1 200 OK");
-    client.println("Content-type:text/html");
-    client.println();
-
-    // HTML content
-    client.println("<!DOCTYPE html>");
-    client.println("<html>");
-    client.println("<body>");
-    client.println("<h1>Wheelwriter Interface Board</h1>");
-    client.println("<p>Created by: <a href=https://github.com/jkua>John Kua</a></p>");
-    client.println("<p><a href=https://github.com/jkua/wheelwriter-interface>GitHub</a></p>");
-    client.println("</body>");
-    client.println("</html>");
+    sendResponse(client, PicoRest::HttpResponse::StatusCode::OK, 
+                 "<!DOCTYPE html>\r\n"
+                 "<html>\r\n"
+                 "<body>\r\n"
+                 "<h1>Wheelwriter Interface Board</h1>\r\n"
+                 "<p>Created by: <a href=https://github.com/jkua>John Kua</a></p>\r\n"
+                 "<p><a href=https://github.com/jkua/wheelwriter-interface>GitHub</a></p>\r\n"
+                 "</body>\r\n"
+                 "</html>");
   }
   
 private:
+  // Strips the query from the path, and takes the priority from it. Returns 
+  // false if the priority isn't one of the names.
+  bool parsePriority(std::string_view& path, wheelwriter::print_job_priority& priority) {
+    priority = wheelwriter::JOB_PRIORITY_NORMAL;
+    size_t start = path.find('?');
+    if (start == std::string_view::npos) {
+      return true;
+    }
+    std::string_view query = path.substr(start + 1);
+    path.remove_suffix(path.length() - start);
+    const std::string_view key = "priority=";
+    size_t position = query.find(key);
+    if ((position == std::string_view::npos) || (position && (query[position - 1] != '&'))) {
+      return true;
+    }
+    size_t end = query.find('&', position);
+    position += key.length();
+    return wheelwriter::parseJobPriority(query.substr(position, end - position), priority);
+  }
+  // Splits /jobs/<id>[/<action>]. Returns the ID, or 0 if the path isn't a job.
+  uint16_t parseJobPath(std::string_view path, std::string_view& action) {
+    const std::string_view prefix = "/jobs/";
+    if (path.compare(0, prefix.length(), prefix) != 0) {
+      return 0;
+    }
+    size_t end = path.find('/', prefix.length());
+    action = (end == std::string_view::npos) ? std::string_view() : path.substr(end + 1);
+    // IDs are 16-bit - anything longer or larger isn't a job
+    std::string_view digits = path.substr(prefix.length(), end - prefix.length());
+    if (digits.length() > 5) {
+      return 0;
+    }
+    uint32_t id = 0;
+    for (char c : digits) {
+      if ((c < '0') || (c > '9')) {
+        return 0;
+      }
+      id = id * 10 + (c - '0');
+    }
+    return (id <= 0xffff) ? id : 0;
+  }
+  void sendJob(WiFiClient& client, PicoRest::HttpResponse::StatusCode status, const wheelwriter::PrintJob* job) {
+    std::string json;
+    if (job) {
+      jobs_.toJson(*job, json);
+    }
+    sendResponse(client, status, json);
+  }
+  void sendSubmitted(WiFiClient& client, uint16_t jobId) {
+    if (!jobId) {
+      sendGenericResponse(client, PicoRest::HttpResponse::StatusCode::SERVICE_UNAVAILABLE);
+      return;
+    }
+    Serial.print("--> Queued job ");
+    Serial.println(jobId);
+    sendJob(client, PicoRest::HttpResponse::StatusCode::ACCEPTED, jobs_.find(jobId));
+  }
+
   wheelwriter::Wheelwriter& typewriter_;
+  wheelwriter::PrintJobQueue jobs_;
   
 };
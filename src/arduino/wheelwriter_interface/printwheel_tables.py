@@ -0,0 +1,156 @@
+# printwheel_tables.py
+#
+# Generates PrintwheelTables.h from wheelwriter_printwheel_mapping.tsv:
+#   python3 printwheel_tables.py > PrintwheelTables.h
+#
+# For each keyboard column in the TSV with characters on it, this makes a
+# table from printwheel position to Unicode, and tables from ISO 8859-1 and
+# Cyrillic (U+0400-U+045F) to printwheel position. A character on the wheel
+# twice is typed from the position nearer "a" (0x01), on the unshifted side
+# of the wheel. Each position also gets an impression level: glyphs with a lot
+# of face (M, W, @) want a heavier strike than the rest, and small
+# punctuation a lighter one.
+
+import csv
+import os
+import re
+
+PRINTWHEEL_POSITIONS = 0x61
+CYRILLIC_FIRST = 0x400
+CYRILLIC_LENGTH = 0x60
+KEYBOARDS_MAX = 256
+
+IMPRESSION_LIGHT = 0
+IMPRESSION_NORMAL = 1
+IMPRESSION_HEAVY = 2
+HEAVY_GLYPHS = 'MWmw@#%&\u00a7\u00b6\u00bc\u00bd\u00be\u00c6\u00e6\u0416\u0428\u0429\u042e\u0436\u0448\u0449\u044e'
+LIGHT_GLYPHS = '.,:;\'`-\u00b4\u00a8\u00b7\u00b8\u00b0'
+
+here = os.path.dirname(os.path.abspath(__file__))
+with open(os.path.join(here, 'wheelwriter_printwheel_mapping.tsv'), newline='', encoding='utf-8') as tsv:
+    rows = list(csv.reader(tsv, delimiter='\t'))
+
+# Header: "001 (US)", "", "026,029 (Germany)", "", ...
+wheels = []
+for column in range(1, len(rows[0]), 2):
+    match = re.match(r'([\d,]+) \(([^)?]+)\??\)', rows[0][column].strip())
+    if not match:
+        continue
+    keyboards = [int(number) for number in match.group(1).split(',')]
+    name = match.group(2)
+    toUnicode = [0] * PRINTWHEEL_POSITIONS
+    for row in rows[2:]:
+        if len(row) <= column + 1 or not row[0].strip():
+            continue
+        position = int(row[0], 16)
+        code = row[column + 1].strip()
+        if code:
+            toUnicode[position] = int(code, 16)
+    if not any(toUnicode[1:]):
+        # Nothing mapped beyond the space, so these keep the default tables
+        continue
+    wheels.append((name, keyboards, toUnicode))
+
+def distance_from_a(position):
+    distance = (position - 1) % (PRINTWHEEL_POSITIONS - 1)
+    return min(distance, PRINTWHEEL_POSITIONS - 1 - distance)
+
+def from_unicode(toUnicode, first, length):
+    table = [0] * length
+    for position in sorted(range(1, PRINTWHEEL_POSITIONS), key=lambda p: (distance_from_a(p), p), reverse=True):
+        code = toUnicode[position]
+        if first <= code < first + length:
+            table[code - first] = position
+    return table
+
+def impression(code):
+    if chr(code) in HEAVY_GLYPHS:
+        return IMPRESSION_HEAVY
+    if chr(code) in LIGHT_GLYPHS:
+        return IMPRESSION_LIGHT
+    return IMPRESSION_NORMAL
+
+def identifier(name):
+    return re.sub(r'\W+', '_', name.strip()).lower()
+
+def format_table(values, width, digits):
+    lines = []
+    for start in range(0, len(values), width):
+        row = ', '.join('0x{:0{}x}'.format(value, digits) for value in values[start:start + width])
+        lines.append('\t' + row + ',')
+    lines[-1] = lines[-1][:-1]
+    return '\n'.join(lines)
+
+print('''// Printwheel translation tables for each keyboard
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+// Generated by printwheel_tables.py from wheelwriter_printwheel_mapping.tsv -
+// edit the TSV and run the script again rather than editing this file.
+// Keyboards not listed (and the symbol wheels, which have nothing in the TSV
+// yet) use the US tables.
+//
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace wheelwriter {{
+
+static constexpr uint8_t WW_PRINTWHEEL_POSITIONS = 0x{:02x};
+static constexpr uint16_t WW_CYRILLIC_FIRST = 0x{:04x};
+static constexpr uint8_t WW_CYRILLIC_LENGTH = 0x{:02x};
+
+// How hard a glyph wants to be struck, for the impression tables
+enum ww_impression_level : uint8_t {{
+	IMPRESSION_LIGHT = {},
+	IMPRESSION_NORMAL = {},
+	IMPRESSION_HEAVY = {},
+	IMPRESSION_LEVELS
+}};
+'''.format(PRINTWHEEL_POSITIONS, CYRILLIC_FIRST, CYRILLIC_LENGTH, IMPRESSION_LIGHT, IMPRESSION_NORMAL, IMPRESSION_HEAVY))
+
+for name, keyboards, toUnicode in wheels:
+    suffix = identifier(name)
+    print('// {} ({})'.format(name, ', '.join('{:03d}'.format(keyboard) for keyboard in keyboards)))
+    print('static constexpr uint16_t ww_printwheel_unicode_{}[WW_PRINTWHEEL_POSITIONS] = {{'.format(suffix))
+    print(format_table(toUnicode, 16, 4))
+    print('};')
+    print('static constexpr uint8_t ww_latin1_printwheel_{}[256] = {{'.format(suffix))
+    print(format_table(from_unicode(toUnicode, 0, 256), 16, 2))
+    print('};')
+    cyrillic = from_unicode(toUnicode, CYRILLIC_FIRST, CYRILLIC_LENGTH)
+    if any(cyrillic):
+        print('static constexpr uint8_t ww_cyrillic_printwheel_{}[WW_CYRILLIC_LENGTH] = {{'.format(suffix))
+        print(format_table(cyrillic, 16, 2))
+        print('};')
+    print('static constexpr uint8_t ww_printwheel_impression_{}[WW_PRINTWHEEL_POSITIONS] = {{'.format(suffix))
+    print(format_table([impression(code) for code in toUnicode], 16, 2))
+    print('};')
+    print()
+
+print('''struct ww_printwheel_tables {
+	const uint16_t* toUnicode;     // Printwheel position to Unicode
+	const uint8_t* fromLatin1;     // ISO 8859-1 to printwheel position
+	const uint8_t* fromCyrillic;   // U+0400-U+045F to printwheel position, or NULL
+	const uint8_t* impression;     // Printwheel position to ww_impression_level
+};
+static constexpr ww_printwheel_tables ww_keyboard_tables[] = {''')
+for index, (name, keyboards, toUnicode) in enumerate(wheels):
+    suffix = identifier(name)
+    cyrillic = any(from_unicode(toUnicode, CYRILLIC_FIRST, CYRILLIC_LENGTH))
+    print('\t{{ww_printwheel_unicode_{0}, ww_latin1_printwheel_{0}, {1}, ww_printwheel_impression_{0}}}{2}  // {3}'.format(
+        suffix, 'ww_cyrillic_printwheel_' + suffix if cyrillic else 'NULL',
+        ',' if index + 1 < len(wheels) else '', name))
+print('};')
+
+index = [0] * KEYBOARDS_MAX
+for number, (name, keyboards, toUnicode) in enumerate(wheels):
+    for keyboard in keyboards:
+        index[keyboard] = number
+print('''// Keyboard number to ww_keyboard_tables entry
+static constexpr uint8_t ww_keyboard_table_index[{}] = {{'''.format(KEYBOARDS_MAX))
+print(format_table(index, 16, 2))
+print('''};
+
+} // namespace wheelwriter''')
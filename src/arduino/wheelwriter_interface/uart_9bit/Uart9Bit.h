@@ -3,19 +3,68 @@
 //
 // Copyright (c) 2023 John Kua <john@kua.fm>
 //
+// Optionally, the PIO FIFOs can be serviced by DMA (see enableDma()). In this
+// mode, RX words are continuously streamed into a ring buffer in SRAM and TX
+// words are drained from a ring buffer, so the CPU never has to spin on a
+// single FIFO word and the RX FIFO cannot overflow during long transactions.
+//
+// In DMA mode, every received word is also stamped with the microsecond timer.
+// The RX data channel is chained to a second channel which copies TIMERAWL
+// into a parallel ring as soon as the word has been pulled from the FIFO, so
+// the timestamp marks the stop bit of the word to within a few bus cycles.
+//
+// The RX state machine can also run an echo-masked program (see
+// setEchoMasked()) which recognises our own transmissions by watching the TX
+// pin, and pushes each reply together with the word it answers instead of
+// pushing the echo and the reply separately.
+//
 #pragma once
 
 #include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/timer.h"
 #include "uart_9bit_tx_inverted.pio.h"
 #include "uart_9bit_rx.pio.h"
+#include "uart_9bit_rx_echo_masked.pio.h"
+
+// Ring buffer sizes in 32-bit words - must be powers of two as the DMA ring
+// wrap is done on the low address bits. Buffers are aligned to their size.
+#define UART_9BIT_RX_RING_BITS 8 // 256 words
+#define UART_9BIT_TX_RING_BITS 6 // 64 words
 
 class Uart9Bit {
 public:
+    // Tagged words read with readTagged() - the layout is the one pushed by
+    // the echo-masked RX program
+    static const uint32_t TAG_WORD_MASK = 0x1ff;
+    static const uint32_t TAG_STOP = 1u << 9;          // Stop bit of the word
+    static const uint32_t TAG_REPLY_SHIFT = 10;        // Reply to the word
+    static const uint32_t TAG_REPLY_STOP = 1u << 19;   // Stop bit of the reply
+    static const uint32_t TAG_REPLY = 1u << 20;        // The word is one we sent
+
+    static uint16_t taggedWord(uint32_t tagged) {
+        return tagged & TAG_WORD_MASK;
+    }
+    static uint16_t taggedReply(uint32_t tagged) {
+        return (tagged >> TAG_REPLY_SHIFT) & TAG_WORD_MASK;
+    }
+    static bool taggedIsReply(uint32_t tagged) {
+        return tagged & TAG_REPLY;
+    }
+    static bool taggedFramingError(uint32_t tagged) {
+        return !(tagged & TAG_STOP) || (taggedIsReply(tagged) && !(tagged & TAG_REPLY_STOP));
+    }
+
     Uart9Bit() {
         init_ = 0;
+        dma_ = 0;
+        echo_masked_ = 0;
     }
     void init(PIO pio, uint sm_tx, uint pin_tx, uint sm_rx, uint pin_rx, uint baud) {
         pio_ = pio;
+        pin_tx_ = pin_tx;
+        pin_rx_ = pin_rx;
+        baud_ = baud;
 
         sm_tx_ = sm_tx;
         offset_tx_ = pio_add_program(pio_, &uart_9bit_tx_inverted_program);
@@ -27,28 +76,338 @@ public:
 
         init_ = 1;
     }
+    // Switches the RX state machine between the plain receiver, which pushes
+    // every word on the line including our own echo, and the echo-masked
+    // receiver. Words received before the switch are discarded.
+    void setEchoMasked(bool masked) {
+        if (!init_ || (masked == (bool)echo_masked_)) return;
+
+        pio_sm_set_enabled(pio_, sm_rx_, false);
+        if (echo_masked_) {
+            pio_remove_program(pio_, &uart_9bit_rx_echo_masked_program, offset_rx_);
+            offset_rx_ = pio_add_program(pio_, &uart_9bit_rx_program);
+            uart_9bit_rx_program_init(pio_, sm_rx_, offset_rx_, pin_rx_, baud_);
+        }
+        else {
+            pio_remove_program(pio_, &uart_9bit_rx_program, offset_rx_);
+            offset_rx_ = pio_add_program(pio_, &uart_9bit_rx_echo_masked_program);
+            uart_9bit_rx_echo_masked_program_init(pio_, sm_rx_, offset_rx_, pin_rx_, pin_tx_, baud_);
+        }
+        echo_masked_ = masked;
+
+        if (dma_) {
+            uint32_t discard;
+            while (readAvailableTagged(&discard, NULL, 1)) {}
+            rx_overrun_ = false;
+        }
+    }
+    bool echoMasked() {
+        return echo_masked_;
+    }
+    // Service the PIO FIFOs with DMA ring buffers. Call after init().
+    void enableDma() {
+        if (!init_ || dma_) return;
+
+        for (uint i = 0; i < RX_RING_SIZE; i++) {
+            rx_ring_[i] = RX_EMPTY;
+        }
+        rx_tail_ = 0;
+        rx_overrun_ = false;
+
+        // RX - one word from the PIO RX FIFO -> data ring, then chain to the
+        // timestamp channel, which chains back. Both write addresses wrap on
+        // their rings and carry on from where they left off when retriggered.
+        dma_rx_ = dma_claim_unused_channel(true);
+        dma_rx_ts_ = dma_claim_unused_channel(true);
+
+        dma_channel_config c = dma_channel_get_default_config(dma_rx_ts_);
+        channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+        channel_config_set_read_increment(&c, false);
+        channel_config_set_write_increment(&c, true);
+        channel_config_set_ring(&c, true, UART_9BIT_RX_RING_BITS + 2);
+        channel_config_set_chain_to(&c, dma_rx_);
+        dma_channel_configure(dma_rx_ts_, &c, rx_ts_ring_, &timer_hw->timerawl, 1, false);
+
+        c = dma_channel_get_default_config(dma_rx_);
+        channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+        channel_config_set_read_increment(&c, false);
+        channel_config_set_write_increment(&c, true);
+        channel_config_set_ring(&c, true, UART_9BIT_RX_RING_BITS + 2);
+        channel_config_set_dreq(&c, pio_get_dreq(pio_, sm_rx_, false));
+        channel_config_set_chain_to(&c, dma_rx_ts_);
+        dma_channel_configure(dma_rx_, &c, rx_ring_, &pio_->rxf[sm_rx_], 1, true);
+
+        // TX - ring buffer -> PIO TX FIFO. Transfers are started on demand
+        // and the read address wraps on the ring.
+        dma_tx_ = dma_claim_unused_channel(true);
+        c = dma_channel_get_default_config(dma_tx_);
+        channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+        channel_config_set_read_increment(&c, true);
+        channel_config_set_write_increment(&c, false);
+        channel_config_set_ring(&c, false, UART_9BIT_TX_RING_BITS + 2);
+        channel_config_set_dreq(&c, pio_get_dreq(pio_, sm_tx_, true));
+        tx_queued_ = 0;
+        tx_started_ = 0;
+        dma_channel_configure(dma_tx_, &c, &pio_->txf[sm_tx_], tx_ring_, 0, false);
+
+        dma_ = 1;
+    }
+    bool dmaEnabled() {
+        return dma_;
+    }
     void write(uint16_t word) {
         if (!init_) return;
+        if (dma_) {
+            while (!writeAsync(&word, 1)) {
+                tight_loop_contents();
+            }
+            return;
+        }
         uart_9bit_tx_inverted_program_put_word(pio_, sm_tx_, word);
     }
     void write(const uint16_t * buffer, uint count) {
         if (!init_) return;
+        if (dma_) {
+            while (count) {
+                uint written = writeAsync(buffer, count);
+                buffer += written;
+                count -= written;
+            }
+            return;
+        }
         uart_9bit_tx_inverted_program_put_buffer(pio_, sm_tx_, buffer, count);
     }
     uint16_t read() {
+        uint32_t timestamp;
+        return read(timestamp);
+    }
+    // Reads a word along with its receive time in microseconds. Without DMA,
+    // the timestamp is the time the word was read from the FIFO.
+    // In echo-masked mode, replies are returned without the word they answer.
+    uint16_t read(uint32_t& timestamp) {
+        if (!init_) return 0xffffffff;
+        return untag(readTagged(timestamp));
+    }
+    uint32_t readTagged() {
+        uint32_t timestamp;
+        return readTagged(timestamp);
+    }
+    // Reads a tagged word (see TAG_*). Without echo masking, every word is
+    // returned as received, with its stop bit set.
+    uint32_t readTagged(uint32_t& timestamp) {
         if (!init_) return 0xffffffff;
+        if (dma_) {
+            uint32_t tagged;
+            while (!readAvailableTagged(&tagged, &timestamp, 1)) {
+                tight_loop_contents();
+            }
+            return tagged;
+        }
         uint32_t fifo = uart_9bit_rx_program_get_word(pio_, sm_rx_);
-        // Bits are coming from the left, so we need to shift right 32-9 bits
-        return fifo >> 23;
+        timestamp = time_us_32();
+        return tag(fifo);
     }
     bool available() {
+        if (dma_) {
+            return rxAvailable() > 0;
+        }
         return !pio_sm_is_rx_fifo_empty(pio_, sm_rx_);
     }
+
+    // Deadline-aware API
+    // ------------------
+    // The reads above block until a word arrives, which is forever if the
+    // other end has gone quiet. These give up after timeout_us microseconds.
+    bool waitAvailable(uint32_t timeout_us) {
+        if (!init_) return false;
+        uint32_t start = time_us_32();
+        while (!available()) {
+            if ((time_us_32() - start) >= timeout_us) {
+                return false;
+            }
+            tight_loop_contents();
+        }
+        return true;
+    }
+    // Returns false if no word was received before the timeout
+    bool read(uint16_t& word, uint32_t timeout_us) {
+        if (!waitAvailable(timeout_us)) return false;
+        word = read();
+        return true;
+    }
+    bool readTagged(uint32_t& tagged, uint32_t timeout_us) {
+        if (!waitAvailable(timeout_us)) return false;
+        tagged = readTagged();
+        return true;
+    }
+    // Restarts the RX state machine and discards anything received, e.g. after
+    // a timeout, so a word cut off mid-frame can't be mistaken for the next one
+    void restartRx() {
+        if (!init_) return;
+        pio_sm_set_enabled(pio_, sm_rx_, false);
+        pio_sm_clear_fifos(pio_, sm_rx_);
+        pio_sm_restart(pio_, sm_rx_);
+        pio_sm_exec(pio_, sm_rx_, pio_encode_jmp(offset_rx_));
+        pio_sm_set_enabled(pio_, sm_rx_, true);
+        if (dma_) {
+            uint32_t discard;
+            while (readAvailableTagged(&discard, NULL, 1)) {}
+            rx_overrun_ = false;
+        }
+    }
+
+    // Non-blocking DMA API
+    // --------------------
+    // Queues up to count words for transmission, returns the number queued
+    uint writeAsync(const uint16_t * buffer, uint count) {
+        if (!init_ || !dma_) return 0;
+        uint free = TX_RING_SIZE - (tx_queued_ - txCompleted());
+        if (count > free) {
+            count = free;
+        }
+        for (uint i = 0; i < count; i++) {
+            // The TX program is inverted
+            tx_ring_[(tx_queued_ + i) & TX_RING_MASK] = ~(uint32_t)buffer[i];
+        }
+        tx_queued_ += count;
+        serviceTx();
+        return count;
+    }
+    // Copies up to count received words into buffer, returns the number copied
+    uint readAvailable(uint16_t * buffer, uint count) {
+        return readAvailable(buffer, NULL, count);
+    }
+    // As above, also copying the receive timestamps (microseconds) if not NULL
+    uint readAvailable(uint16_t * buffer, uint32_t * timestamps, uint count) {
+        if (!init_ || !dma_) return 0;
+        uint32_t available = rxAvailable();
+        if (count > available) {
+            count = available;
+        }
+        for (uint i = 0; i < count; i++) {
+            uint32_t index = (rx_tail_ + i) & RX_RING_MASK;
+            buffer[i] = untag(tag(rx_ring_[index]));
+            if (timestamps) {
+                timestamps[i] = rx_ts_ring_[index];
+            }
+            rx_ring_[index] = RX_EMPTY;
+        }
+        rx_tail_ = (rx_tail_ + count) & RX_RING_MASK;
+        return count;
+    }
+    // As above, copying tagged words (see TAG_*)
+    uint readAvailableTagged(uint32_t * buffer, uint32_t * timestamps, uint count) {
+        if (!init_ || !dma_) return 0;
+        uint32_t available = rxAvailable();
+        if (count > available) {
+            count = available;
+        }
+        for (uint i = 0; i < count; i++) {
+            uint32_t index = (rx_tail_ + i) & RX_RING_MASK;
+            buffer[i] = tag(rx_ring_[index]);
+            if (timestamps) {
+                timestamps[i] = rx_ts_ring_[index];
+            }
+            rx_ring_[index] = RX_EMPTY;
+        }
+        rx_tail_ = (rx_tail_ + count) & RX_RING_MASK;
+        return count;
+    }
+    // Number of words waiting in the RX ring buffer
+    uint32_t rxAvailable() {
+        if (!dma_) return 0;
+        // The timestamp is written last, so its write address marks the head
+        uint32_t head = ringIndex(dma_rx_ts_, rx_ts_ring_);
+        uint32_t available = (head - rx_tail_) & RX_RING_MASK;
+        // Consumed slots are marked empty, so if the slot the data channel
+        // will write next is occupied, the DMA has lapped us. Re-read the
+        // write address in case a word landed in that slot in the meantime.
+        uint32_t next = ringIndex(dma_rx_, rx_ring_);
+        if ((rx_ring_[next] != RX_EMPTY) && (next == ringIndex(dma_rx_, rx_ring_))) {
+            // The oldest valid word is in the next slot
+            rx_tail_ = next;
+            rx_overrun_ = true;
+            available = ((head - next - 1) & RX_RING_MASK) + 1;
+        }
+        return available;
+    }
+    // Number of words queued but not yet handed to the PIO
+    uint32_t txPending() {
+        if (!dma_) return 0;
+        serviceTx();
+        return tx_queued_ - txCompleted();
+    }
+    // True when the last queued word has left the TX FIFO
+    bool txIdle() {
+        return (txPending() == 0) && pio_sm_is_tx_fifo_empty(pio_, sm_tx_);
+    }
+    // Returns and clears the RX overrun flag
+    bool rxOverrun() {
+        bool overrun = rx_overrun_;
+        rx_overrun_ = false;
+        return overrun;
+    }
 private:
+    static const uint32_t RX_RING_SIZE = 1u << UART_9BIT_RX_RING_BITS;
+    static const uint32_t RX_RING_MASK = RX_RING_SIZE - 1;
+    static const uint32_t TX_RING_SIZE = 1u << UART_9BIT_TX_RING_BITS;
+    static const uint32_t TX_RING_MASK = TX_RING_SIZE - 1;
+    // The PIO only fills the top 9 bits, so this is never a received word
+    static const uint32_t RX_EMPTY = 0xffffffff;
+
+    // Converts a word from the RX FIFO to the tagged layout
+    uint32_t tag(uint32_t fifo) {
+        if (echo_masked_) {
+            // 21 bits are pushed, so we need to shift right 32-21 bits
+            return fifo >> 11;
+        }
+        // Bits are coming from the left, so we need to shift right 32-9 bits
+        return (fifo >> 23) | TAG_STOP;
+    }
+    // The word a plain read returns - the reply if the word was one we sent
+    static uint16_t untag(uint32_t tagged) {
+        return taggedIsReply(tagged) ? taggedReply(tagged) : taggedWord(tagged);
+    }
+
+    // Ring index of the next slot a channel will write
+    uint32_t ringIndex(uint channel, const uint32_t * ring) {
+        return (((uint32_t)dma_channel_hw_addr(channel)->write_addr - (uint32_t)ring) /
+                sizeof(uint32_t)) & RX_RING_MASK;
+    }
+    // Words the TX DMA has read from the ring
+    uint32_t txCompleted() {
+        return tx_started_ - dma_channel_hw_addr(dma_tx_)->transfer_count;
+    }
+    // Starts a transfer for any words queued since the last one completed
+    void serviceTx() {
+        if (dma_channel_is_busy(dma_tx_) || (tx_started_ == tx_queued_)) {
+            return;
+        }
+        dma_channel_set_read_addr(dma_tx_, tx_ring_ + (tx_started_ & TX_RING_MASK), false);
+        dma_channel_set_trans_count(dma_tx_, tx_queued_ - tx_started_, true);
+        tx_started_ = tx_queued_;
+    }
+
     uint init_;
     PIO pio_;
     uint sm_tx_;
     uint offset_tx_;
     uint sm_rx_;
     uint offset_rx_;
+    uint pin_tx_;
+    uint pin_rx_;
+    uint baud_;
+    uint echo_masked_;
+
+    uint dma_;
+    uint dma_rx_;
+    uint dma_rx_ts_;
+    uint dma_tx_;
+    alignas(4 << UART_9BIT_RX_RING_BITS) uint32_t rx_ring_[1 << UART_9BIT_RX_RING_BITS];
+    alignas(4 << UART_9BIT_RX_RING_BITS) uint32_t rx_ts_ring_[1 << UART_9BIT_RX_RING_BITS];
+    alignas(4 << UART_9BIT_TX_RING_BITS) uint32_t tx_ring_[1 << UART_9BIT_TX_RING_BITS];
+    uint32_t rx_tail_;
+    bool rx_overrun_;
+    uint32_t tx_queued_;
+    uint32_t tx_started_;
 };
@@ -0,0 +1,92 @@
+// ----------------------------------------------------------------- //
+// Hand-assembled from uart_9bit_rx_echo_masked.pio, laid out as      //
+// pioasm would lay it out - NOT generated by pioasm. Keep it in step //
+// with the .pio by hand, or regenerate it with pioasm.               //
+// ----------------------------------------------------------------- //
+
+#pragma once
+
+#if !PICO_NO_HARDWARE
+#include "hardware/pio.h"
+#endif
+
+// ------------------------ //
+// uart_9bit_rx_echo_masked //
+// ------------------------ //
+
+#define uart_9bit_rx_echo_masked_wrap_target 0
+#define uart_9bit_rx_echo_masked_wrap 8
+
+static const uint16_t uart_9bit_rx_echo_masked_program_instructions[] = {
+            //     .wrap_target
+    0x20a0, //  0: wait   1 pin, 0                   
+    0x2020, //  1: wait   0 pin, 0                   
+    0x00c9, //  2: jmp    pin, 9                     
+    0xe928, //  3: set    x, 8                   [9] 
+    0x4001, //  4: in     pins, 1                    
+    0x0644, //  5: jmp    x--, 4                 [6] 
+    0x4001, //  6: in     pins, 1                    
+    0x406b, //  7: in     null, 11                   
+    0x8020, //  8: push   block                      
+            //     .wrap
+    0xe928, //  9: set    x, 8                   [9] 
+    0x4001, // 10: in     pins, 1                    
+    0x064a, // 11: jmp    x--, 10                [6] 
+    0x4001, // 12: in     pins, 1                    
+    0xa0e0, // 13: mov    osr, pins                  
+    0x6041, // 14: out    y, 1                       
+    0x00d8, // 15: jmp    pin, 24                    
+    0x008d, // 16: jmp    y--, 13                    
+    0xe528, // 17: set    x, 8                   [5] 
+    0x4001, // 18: in     pins, 1                    
+    0x0652, // 19: jmp    x--, 18                [6] 
+    0x4001, // 20: in     pins, 1                    
+    0x4041, // 21: in     y, 1                       
+    0x8020, // 22: push   block                      
+    0x0001, // 23: jmp    1                          
+    0xa0c3, // 24: mov    isr, null                  
+    0xe628, // 25: set    x, 8                   [6] 
+    0x000a, // 26: jmp    10                         
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program uart_9bit_rx_echo_masked_program = {
+    .instructions = uart_9bit_rx_echo_masked_program_instructions,
+    .length = 27,
+    .origin = -1,
+};
+
+static inline pio_sm_config uart_9bit_rx_echo_masked_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + uart_9bit_rx_echo_masked_wrap_target, offset + uart_9bit_rx_echo_masked_wrap);
+    return c;
+}
+
+static inline void uart_9bit_rx_echo_masked_program_init(PIO pio, uint sm, uint offset, uint pin, uint pin_tx, uint baud) {
+    pio_sm_set_consecutive_pindirs(pio, sm, pin, 1, false);
+    pio_gpio_init(pio, pin);
+    gpio_pull_up(pin);
+    pio_sm_config c = uart_9bit_rx_echo_masked_program_get_default_config(offset);
+    sm_config_set_in_pins(&c, pin); // for WAIT, IN, MOV
+    sm_config_set_jmp_pin(&c, pin_tx); // for JMP - TX is driven by another SM
+    // Shift to right, autopush disabled
+    sm_config_set_in_shift(&c, true, false, 32);
+    // OSR is only used to pick the RX pin out of MOV OSR, PINS
+    sm_config_set_out_shift(&c, true, false, 32);
+    // Deeper FIFO as we're not doing any TX
+    sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_RX);
+    // SM transmits 1 bit per 8 execution cycles.
+    float div = (float)clock_get_hz(clk_sys) / (8 * baud);
+    sm_config_set_clkdiv(&c, div);
+    pio_sm_init(pio, sm, offset, &c);
+    pio_sm_set_enabled(pio, sm, true);
+}
+static inline uint32_t uart_9bit_rx_echo_masked_program_get_word(PIO pio, uint sm) {
+    io_rw_32 *rxfifo_shift = (io_rw_32*)&pio->rxf[sm];
+    while (pio_sm_is_rx_fifo_empty(pio, sm))
+        tight_loop_contents();
+    return (uint32_t)*rxfifo_shift;
+}
+
+#endif
+
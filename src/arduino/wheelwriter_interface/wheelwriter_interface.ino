@@ -5,7 +5,13 @@
 #include <WiFiNINA.h>
 #include "ParameterStorage.h"
 
+#ifdef WHEELWRITER_SIM
+#include "SimUart9Bit.h"
+#else
 #include "uart_9bit/Uart9bit.h"
+#include "pico/multicore.h"
+#endif
+#include "BusCore.h"
 #include "Wheelwriter.h"
 #include "WheelwriterCommandLineInterface.h"
 #include "WheelwriterRestApi.h"
@@ -13,6 +19,7 @@
 WiFiServer webServer(80);
 ParameterStorage parameterStorage;
 Uart9Bit uart;
+wheelwriter::BusCore busCore;
 wheelwriter::Wheelwriter typewriter;
 WheelwriterRestApi restApi(webServer, typewriter);
 int inByte = 0;
@@ -23,6 +30,13 @@ wheelwriter::WheelwriterCommandLineInterface typewriterCli(typewriter,
                                                            wheelwriter::IF_TYPEWRITER);
 bool terminalMode = false;
 
+// The second core runs the bus and nothing else
+void busCoreMain() {
+  while (true) {
+    busCore.run();
+  }
+}
+
 void setup() {
   gpio_set_drive_strength(25, GPIO_DRIVE_STRENGTH_12MA);
 
@@ -39,7 +53,16 @@ void setup() {
   uint sm_rx = 1;
   uint pin_rx = 15; // D3/GPIO15
   uart.init(pio0, sm_tx, pin_tx, sm_rx, pin_rx, 185700);
+  uart.enableDma();
+  uart.setEchoMasked(true);
   typewriter.init(&uart);
+  typewriter.setBusCore(&busCore);
+#ifdef WHEELWRITER_SIM
+  // No second core - the bus is run whenever the typewriter is serviced
+  busCore.setInline(true);
+#else
+  multicore_launch_core1(busCoreMain);
+#endif
 
   // USB Serial
   Serial.begin(115200);
@@ -77,6 +100,8 @@ void setup() {
 void loop() {
   while (!Serial.available()) {// && !typewriter.available()) {
     restApi.processClient();
+    restApi.serviceJobs();
+    typewriter.service();
   }
 
   // while (typewriter.available()) {
@@ -148,6 +173,8 @@ void loop() {
 
     ParameterString parameters(inString.c_str(), ' ');
     std::string command = parameters.getParameterString(0);
+    // The command has the typewriter to itself - the print jobs carry on where they left off afterwards
+    restApi.suspendJobs();
 
     if (command.size() == 0) {
       // Do nothing, loop back to the ready prompt
@@ -165,6 +192,7 @@ void loop() {
       Serial.write("read - read bus commands\n");
       Serial.write("relay - relay bus commands\n");
       Serial.write("sample - print a type sample\n");
+      Serial.write("sniff - stream timestamped bus words in binary\n");
       Serial.write("type - type characters on the typewriter\n");
       Serial.write("wifi - set up WiFi\n");
     }
@@ -248,7 +276,10 @@ void loop() {
       Serial.write("[FUNCTION] Relay commands\n");
       relayFunction();
     }
-    
+    else if (command == "sniff") {
+      Serial.write("[FUNCTION] Sniff Bus\n");
+      sniffFunction();
+    }
     else if (command == "sample") {
       uint8_t plusPosition = parameters.getParameterInt(1, 0x3b);
       uint8_t underscorePosition = parameters.getParameterInt(2, 0x4f);
@@ -263,13 +294,25 @@ void loop() {
     else if (command == "type") {
       uint8_t keyboard = parameters.getParameterInt(1, 1);
       uint8_t useCaratAsControl = parameters.getParameterInt(2, 1);
+      uint8_t bidirectional = parameters.getParameterInt(3, 0);
+      uint8_t ordered = parameters.getParameterInt(4, 0);
+      uint8_t overwrite = parameters.getParameterInt(5, 0);
+      uint8_t impression = parameters.getParameterInt(6, 0);
 
       Serial.write("[FUNCTION] Type ");
       Serial.write("| Keyboard: ");
       Serial.print(keyboard);
       Serial.write(", UseCaratAsControl: ");
-      Serial.println(useCaratAsControl);
-      typeFunction(keyboard, useCaratAsControl);
+      Serial.print(useCaratAsControl);
+      Serial.write(", Bidirectional: ");
+      Serial.print(bidirectional);
+      Serial.write(", Ordered: ");
+      Serial.print(ordered);
+      Serial.write(", Overwrite: ");
+      Serial.print(overwrite);
+      Serial.write(", Impression: ");
+      Serial.println(impression);
+      typeFunction(keyboard, useCaratAsControl, bidirectional, ordered, overwrite, impression);
     }
     else if (command == "wifi") {
       Serial.write("[FUNCTION] Configure wifi\n");
@@ -301,6 +344,7 @@ void loop() {
     else {
       Serial.write("[UNKNOWN FUNCTION] Enter 'help' to see a list of available commands\n");
     }
+    restApi.releaseJobs();
     Serial.write("[READY]\n");
   }
 }
@@ -347,6 +391,10 @@ void keyboardFunction(uint8_t verbose) {
 
 void loopbackTest() {
   typewriter.readFlush();
+  // Take the UART back from the bus core
+  busCore.pause();
+  // The loopback test reads back our own echo
+  uart.setEchoMasked(false);
 
   while (true) {
     Serial.write("\nPress Enter to send query, q to quit...\n");
@@ -390,6 +438,8 @@ void loopbackTest() {
       Serial.println(value, HEX);
     }
   }
+  uart.setEchoMasked(true);
+  busCore.resume();
 }
 
 void queryFunction() {
@@ -477,7 +527,8 @@ void readFunction() {
         break;
       }
     }
-    // typewriter.readFlush();
+    // Frames are decoded as they come in, so the REST server keeps going
+    restApi.processClient();
     uint8_t blocking = 0;
     uint8_t verbose = 1;
     uint8_t commandLength = typewriter.readCommand(blocking, verbose);
@@ -490,10 +541,82 @@ void readFunction() {
       lastCommandTime = 0;
     }
   }
+  wheelwriter::BusFrameDecoder& frames = typewriter.frameDecoder();
+  if (frames.resyncs() || frames.overruns() || busCore.droppedWords()) {
+    Serial.write("\nResynchronised: ");
+    Serial.print(frames.resyncs());
+    Serial.write(", frames dropped: ");
+    Serial.print(frames.overruns());
+    Serial.write(", words dropped: ");
+    Serial.println(busCore.droppedWords());
+  }
   
   Serial.write("\n[END]\n");
 }
 
+// Binary sniffer record - 4 bytes, little endian
+// - bits 0-8: 9-bit bus word
+// - bits 9-31: microseconds since the previous record (saturates at SNIFF_DELTA_MAX)
+// A delta of SNIFF_DELTA_MARKER flags a marker record rather than a bus word
+const uint32_t SNIFF_DELTA_MAX = 0x7ffffe;
+const uint32_t SNIFF_DELTA_MARKER = 0x7fffff;
+const uint16_t SNIFF_MARKER_OVERRUN = 0x000; // Words were dropped before this point
+const uint16_t SNIFF_MARKER_END = 0x1ff;     // End of the record stream
+
+size_t sniffEncode(uint8_t* buffer, uint16_t word, uint32_t delta) {
+  uint32_t record = (delta << 9) | (word & 0x1ff);
+  buffer[0] = record & 0xff;
+  buffer[1] = (record >> 8) & 0xff;
+  buffer[2] = (record >> 16) & 0xff;
+  buffer[3] = (record >> 24) & 0xff;
+  return 4;
+}
+
+void sniffFunction() {
+  const uint batchSize = 64;
+  uint16_t words[batchSize];
+  uint32_t timestamps[batchSize];
+  uint8_t records[(batchSize + 1) * 4];
+
+  typewriter.readFlush();
+  busCore.pause();
+  // Capture everything on the line, including our own transmissions
+  uart.setEchoMasked(false);
+  uart.rxOverrun();
+  Serial.write("[BEGIN]\n");
+  uint32_t lastTimestamp = time_us_32();
+  while (true) {
+    if (Serial.available()) {
+      // End with 'q' or EOT (CTRL-D)
+      char inByte = Serial.read();
+      if ((inByte == 'q') || (inByte == 0x04)) {
+        break;
+      }
+    }
+    size_t length = 0;
+    if (uart.rxOverrun()) {
+      length += sniffEncode(records + length, SNIFF_MARKER_OVERRUN, SNIFF_DELTA_MARKER);
+    }
+    uint count = uart.readAvailable(words, timestamps, batchSize);
+    for (uint i = 0; i < count; i++) {
+      uint32_t delta = timestamps[i] - lastTimestamp;
+      if (delta > SNIFF_DELTA_MAX) {
+        delta = SNIFF_DELTA_MAX;
+      }
+      lastTimestamp = timestamps[i];
+      length += sniffEncode(records + length, words[i], delta);
+    }
+    if (length) {
+      Serial.write(records, length);
+    }
+  }
+  uart.setEchoMasked(true);
+  busCore.resume();
+  sniffEncode(records, SNIFF_MARKER_END, SNIFF_DELTA_MARKER);
+  Serial.write(records, 4);
+  Serial.write("\n[END]\n");
+}
+
 void relayFunction() {
   typewriter.readFlush();
   Serial.write("[BEGIN]\n");
@@ -513,12 +636,12 @@ void relayFunction() {
       if (inByte == 0x0a) { // \n, NOOP
         continue;
       }
-      if (inByte & 0x10) {
+      if ((inByte & 0xf8) == 0x10) {
         relayCommand(inByte, commandStartTime, timeout);
         continue;
       }
-      if (inByte & 0x80) {
-        //configCommand(inByte, commandStartTime, timeout);
+      if (((inByte & 0xf0) == 0xd0) || ((inByte & 0xf0) == 0xe0)) {
+        configCommand(inByte, commandStartTime, timeout);
         continue;
       }
 
@@ -545,6 +668,94 @@ void relayFunction() {
   Serial.write("\n[END]\n");
 }
 
+// Relay parameters (see docs/wwib_relay_protocol.md)
+uint8_t relayTimeout = 0;   // Milliseconds to wait for each ACK - 0 for each command's own default
+
+void configCommand(unsigned char commandByte, unsigned long commandStartTime, unsigned long timeout) {
+  bool set = ((commandByte & 0xf0) == 0xe0);
+  uint8_t parameter = commandByte & 0x0f;
+  unsigned char response[4];
+  response[0] = commandByte;
+  response[3] = '\n';
+
+  // Read the value and terminator
+  unsigned char buffer[2];
+  size_t expectedBytes = set ? 2 : 1;
+  if (Serial.readBytes(buffer, expectedBytes) < expectedBytes) {
+    sendTimeoutResponse(commandByte);
+    return;
+  }
+  if (buffer[expectedBytes - 1] != '\n') {
+    response[1] = 0xf1; // Invalid command length
+    response[2] = expectedBytes + 1;
+    Serial.write(response, 4);
+    return;
+  }
+
+  response[1] = set ? 0xe0 : 0xd0;  // Parameter config/query success
+  switch (parameter) {
+    case 0x00: // Destination address
+      if (set) {
+        typewriter.setDefaultAddress(buffer[0]);
+      }
+      response[2] = typewriter.getDefaultAddress();
+      break;
+    case 0x01: // Command timeout
+      if (set) {
+        relayTimeout = buffer[0];
+      }
+      response[2] = relayTimeout;
+      break;
+    default:
+      response[1] = set ? 0xe3 : 0xd3;  // Invalid parameter
+      response[2] = commandByte;
+  }
+  Serial.write(response, 4);
+}
+
+// Collects the results of a pipelined relay batch as the transactions finish
+struct RelayBatchResult {
+  uint8_t completed;    // Number of transactions finished, in order
+  bool failed;
+  uint8_t failedIndex;  // Index of the first failed command in the batch
+  uint8_t error;
+  uint8_t failIndex;
+  uint8_t response;     // Response to the last completed command
+};
+
+void relayCallback(const wheelwriter::BusTransaction& transaction, void* context) {
+  RelayBatchResult* result = (RelayBatchResult*)context;
+  if (transaction.state == wheelwriter::TRANSACTION_COMPLETE) {
+    result->response = transaction.response;
+  }
+  else if (!result->failed) {
+    result->failed = true;
+    result->failedIndex = result->completed;
+    result->error = transaction.error;
+    result->failIndex = transaction.failIndex;
+  }
+  result->completed++;
+}
+
+// Reads from Serial while servicing the typewriter, so queued commands keep 
+// running while the rest of a batch arrives. Returns the number of bytes read.
+int relayReadBytes(unsigned char* buffer, int length, unsigned long timeout) {
+  unsigned long startTime = millis();
+  int bytesRead = 0;
+  while (bytesRead < length) {
+    if (Serial.available()) {
+      buffer[bytesRead++] = Serial.read();
+      startTime = millis();
+      continue;
+    }
+    typewriter.service();
+    if ((millis() - startTime) > timeout) {
+      break;
+    }
+  }
+  return bytesRead;
+}
+
 void relayCommand(char commandByte, unsigned long commandStartTime, unsigned long timeout) {  
   bool abbreviatedFlag = (commandByte & 0x01);
   bool batchFlag = (commandByte & 0x02);
@@ -565,62 +776,63 @@ void relayCommand(char commandByte, unsigned long commandStartTime, unsigned lon
     }
   }
 
-  // Read and relay the commands
+  // Read and relay the commands. Each command is queued as soon as it has been 
+  // received, so the typewriter works through the batch while it streams in.
   unsigned char commandBuffer[4];
   unsigned char response[4];
   response[0] = commandByte;
   response[1] = 0x10;
   response[3] = '\n';
-  int bytesRead, expectedBytes;
+  int bytesRead;
+  int expectedBytes = abbreviatedFlag ? 3 : 4;
+  RelayBatchResult result = {};
+  unsigned char submitted = 0;
   if (abbreviatedFlag) {
     commandBuffer[0] = typewriter.getDefaultAddress();
   }
   for (unsigned char i = 0; i < batchSize; i++) {
     if (abbreviatedFlag) {
-      expectedBytes = 3;
-      bytesRead = Serial.readBytes(commandBuffer+1, expectedBytes);
+      bytesRead = relayReadBytes(commandBuffer+1, expectedBytes, timeout);
     }
     else {
-      expectedBytes = 4;
-      bytesRead = Serial.readBytes(commandBuffer, expectedBytes);
+      bytesRead = relayReadBytes(commandBuffer, expectedBytes, timeout);
     }
     if (bytesRead < expectedBytes) {
+      typewriter.flush();
       sendTimeoutResponse(commandByte);
       return;
     }
-    uint8_t error, failIndex;
-    // Serial.write("Sending command\n");
-    // Serial.write(commandBuffer, 4);
-    // Serial.write('\n');
-    uint8_t wwCmdResponse = typewriter.sendCommand(commandBuffer[0], commandBuffer[1], commandBuffer[2], commandBuffer[3], error, failIndex, (int)ignoreErrorsFlag);
-    if (!ignoreErrorsFlag && error) {
-        if (batchFlag) {
-          response[1] = 0x12; // Batch error
-          response[2] = i;    // Failed command index
-        }
-        else {
-          response[1] = error;      // Command error code
-          response[2] = failIndex;  // Command byte that failed
-        }
-        Serial.write(response, 4);
-        return;
+    // Once a command has failed, drain the rest of the batch without queuing it
+    if (!ignoreErrorsFlag && result.failed) {
+      continue;
+    }
+    typewriter.sendCommandAsync(commandBuffer[0], commandBuffer[1], commandBuffer[2], commandBuffer[3], 
+                                (int)ignoreErrorsFlag, relayCallback, &result, !ignoreErrorsFlag, relayTimeout);
+    submitted++;
+  }
+
+  // Wait for the batch to finish
+  while (result.completed < submitted) {
+    typewriter.service();
+  }
+  if (!ignoreErrorsFlag && result.failed) {
+    if (batchFlag) {
+      response[1] = 0x12; // Batch error
+      response[2] = result.failedIndex; // Failed command index
     }
     else {
-      response[2] = wwCmdResponse;
+      response[1] = result.error;      // Command error code
+      response[2] = result.failIndex;  // Command byte that failed
     }
+    Serial.write(response, 4);
+    return;
   }
+  response[2] = result.response;
 
   // Read terminator
-  // Serial.write("Reading terminator\n");
   unsigned char inByte;
   bytesRead = Serial.readBytes(&inByte, 1);
-  // Serial.write("bytesRead: ");
-  // Serial.write(bytesRead);
-  // Serial.write('\n');
   if (bytesRead) {
-    // Serial.write("inByte: ");
-    // Serial.write(inByte);
-    // Serial.write('\n');
     if (inByte != '\n') {
       response[1] = 0x15; // Command length error
       response[2] = expectedBytes * batchSize;  // Expected length
@@ -653,20 +865,29 @@ void sendTimeoutResponse(unsigned char commandByte) {
   Serial.write(response, 4);
 }
 
-void typeFunction(uint8_t keyboard, uint8_t useCaratAsControl) {
+void typeFunction(uint8_t keyboard, uint8_t useCaratAsControl, uint8_t bidirectional, uint8_t ordered, uint8_t overwrite, uint8_t impression) {
   uint8_t bytesAvailable = 0;
   uint8_t paused = false;
 
+  // The model decides which repeat modes and impressions can be used
+  typewriter.queryModel();
   typewriter.setSpaceForWheel();
   typewriter.setKeyboard(keyboard);
   typewriter.setLeftMargin();
+  typewriter.setTopOfPage();
 
   typewriter.typeStream.reset();
   typewriter.typeStream.setUseCaratAsControl(useCaratAsControl);
+  typewriter.setAsync(true);
+  typewriter.setBidirectional(bidirectional);
+  typewriter.setStrikeOrdering(ordered);
+  typewriter.setOverwrite(overwrite);
+  typewriter.setImpressionControl(impression);
 
   Serial.write("[BEGIN]\n");
 
   while (true) {
+    typewriter.service();
     bytesAvailable = Serial.available();
 
     // Flow control
@@ -686,6 +907,12 @@ void typeFunction(uint8_t keyboard, uint8_t useCaratAsControl) {
       }
     }
   }
+  typewriter.clearRepeatMode();
+  typewriter.setAsync(false);
+  typewriter.setBidirectional(false);
+  typewriter.setStrikeOrdering(false);
+  typewriter.setOverwrite(false);
+  typewriter.setImpressionControl(false);
 
   Serial.write("\n[END]\n");
 }
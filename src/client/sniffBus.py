@@ -0,0 +1,31 @@
+#!/usr/bin/env python3
+
+import sys
+
+from wheelwriterClient import WheelwriterInterface, WWSniffMode
+
+if __name__=='__main__':
+	import argparse
+	parser = argparse.ArgumentParser()
+	parser.add_argument('--device', '-d', required=True, help='Serial port to connect to')
+	parser.add_argument('--gap', '-g', type=int, default=1000, help='Start a new line after a gap of this many microseconds')
+	args = parser.parse_args()
+
+	# The records are binary, so XON/XOFF must be disabled
+	with WheelwriterInterface(args.device, xonxoff=False) as interface:
+		with WWSniffMode(interface) as sniffer:
+			print('*** Press CTRL+C to stop ***')
+			lastTimestamp = None
+			try:
+				for timestamp, word in sniffer.records():
+					if word is None:
+						print('\n*** OVERRUN - words dropped ***')
+						continue
+					delta = 0 if lastTimestamp is None else timestamp - lastTimestamp
+					lastTimestamp = timestamp
+					if (word & 0x100) or delta > args.gap:
+						sys.stdout.write(f'\n[{timestamp:>12d} us]')
+					sys.stdout.write(f' 0x{word:03x} (+{delta} us)')
+					sys.stdout.flush()
+			except KeyboardInterrupt:
+				print('')
@@ -46,6 +46,51 @@ class WWReadMode(WWMode):
 		except KeyboardInterrupt:
 			return
 
+class WWSniffMode(WWMode):
+	# Record format: bits 0-8 bus word, bits 9-31 microseconds since the previous record
+	RECORD_SIZE = 4
+	DELTA_MARKER = 0x7fffff
+	MARKER_OVERRUN = 0x000
+	MARKER_END = 0x1ff
+
+	def __init__(self, wwClient):
+		super().__init__(wwClient)
+		self.ended = False
+
+	def __enter__(self):
+		super().switchMode('sniff')
+		return self
+
+	def __exit__(self, exception_type, exception_value, traceback):
+		if not self.ended:
+			self.wwClient.ser.write(b'\x04')
+			# Drain records until the end marker
+			for _ in self.records():
+				pass
+		self.wwClient.ser.readline()
+		self.wwClient.ser.readline()
+		self.wwClient.state = 'READY'
+
+	def records(self):
+		'''Yields (timestamp_us, word) tuples, or (timestamp_us, None) for an overrun'''
+		timestamp = 0
+		while True:
+			data = self.wwClient.ser.read(self.RECORD_SIZE)
+			if len(data) < self.RECORD_SIZE:
+				continue
+			record = int.from_bytes(data, 'little')
+			word = record & 0x1ff
+			delta = record >> 9
+			if delta == self.DELTA_MARKER:
+				if word == self.MARKER_END:
+					self.ended = True
+					return
+				yield timestamp, None
+				continue
+			timestamp += delta
+			yield timestamp, word
+
+
 class WWRelayMode(WWMode):
 	def __init__(self, wwClient):
 		super().__init__(wwClient)
@@ -104,6 +149,19 @@ class WWRelayMode(WWMode):
 		commandBytes += [self.terminator]
 		return self._transmitCommand(commandBytes)
 
+	def getTimeout(self):
+		return self._transmitCommand([0xd1, self.terminator], successStatus=0xd0)
+
+	def setTimeout(self, timeout):
+		# Milliseconds to wait for each ACK, 0 uses the per-command defaults
+		return self._transmitCommand([0xe1, timeout, self.terminator], successStatus=0xe0)
+
+	def getAddress(self):
+		return self._transmitCommand([0xd0, self.terminator], successStatus=0xd0)
+
+	def setAddress(self, address):
+		return self._transmitCommand([0xe0, address, self.terminator], successStatus=0xe0)
+
 	def _transmitCommand(self, command, successStatus=0x10):
 		command = bytearray(command)
 		ifCommand = command[0]
@@ -0,0 +1,121 @@
+// Minimal Arduino API for building the sketch sources on a Linux host
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+#include "Arduino.h"
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+HostSerial Serial;
+
+// Longest a write waits for the reader before the rest is dropped, in real
+// milliseconds - a USB host that isn't reading doesn't block the board forever
+static const int WRITE_TIMEOUT_MS = 1000;
+
+size_t HostSerial::write(const uint8_t* buffer, size_t size) {
+	size_t written = 0;
+	while (written < size) {
+		ssize_t count = ::write(out_, buffer + written, size - written);
+		if (count > 0) {
+			written += count;
+			continue;
+		}
+		if ((count < 0) && ((errno == EAGAIN) || (errno == EINTR))) {
+			struct pollfd pfd = {out_, POLLOUT, 0};
+			if (poll(&pfd, 1, WRITE_TIMEOUT_MS) > 0) {
+				continue;
+			}
+		}
+		break;
+	}
+	return written;
+}
+size_t HostSerial::print(long value, int base) {
+	if (base == DEC) {
+		char buffer[24];
+		snprintf(buffer, sizeof(buffer), "%ld", value);
+		return write(buffer);
+	}
+	return print((unsigned long)value, base);
+}
+size_t HostSerial::print(unsigned long value, int base) {
+	char buffer[24];
+	snprintf(buffer, sizeof(buffer), (base == HEX) ? "%lX" : "%lu", value);
+	return write(buffer);
+}
+
+void HostSerial::fill() {
+	if (in_ < 0) return;
+	uint8_t buffer[RX_BUFFER_SIZE];
+	size_t space = RX_BUFFER_SIZE - rxBuffer_.size();
+	if (!space) return;
+	ssize_t count = ::read(in_, buffer, space);
+	if (count > 0) {
+		rxBuffer_.insert(rxBuffer_.end(), buffer, buffer + count);
+	}
+}
+int HostSerial::available() {
+	fill();
+	if (rxBuffer_.empty()) {
+		if (in_ >= 0) {
+			sim::advance(POLL_US);
+		}
+		if (pollHook_) {
+			pollHook_();
+		}
+	}
+	return rxBuffer_.size();
+}
+int HostSerial::read() {
+	if (rxBuffer_.empty()) {
+		fill();
+		if (rxBuffer_.empty()) return -1;
+	}
+	uint8_t byte = rxBuffer_.front();
+	rxBuffer_.pop_front();
+	return byte;
+}
+int HostSerial::peek() {
+	if (rxBuffer_.empty()) {
+		fill();
+		if (rxBuffer_.empty()) return -1;
+	}
+	return rxBuffer_.front();
+}
+int HostSerial::timedRead() {
+	unsigned long start = millis();
+	do {
+		if (available()) {
+			return read();
+		}
+	} while ((millis() - start) < timeout_);
+	return -1;
+}
+size_t HostSerial::readBytes(uint8_t* buffer, size_t length) {
+	size_t count = 0;
+	while (count < length) {
+		int c = timedRead();
+		if (c < 0) break;
+		buffer[count++] = c;
+	}
+	return count;
+}
+size_t HostSerial::readBytesUntil(char terminator, char* buffer, size_t length) {
+	size_t count = 0;
+	while (count < length) {
+		int c = timedRead();
+		if ((c < 0) || (c == terminator)) break;
+		buffer[count++] = c;
+	}
+	return count;
+}
+String HostSerial::readStringUntil(char terminator) {
+	String string;
+	while (true) {
+		int c = timedRead();
+		if ((c < 0) || (c == terminator)) break;
+		string += (char)c;
+	}
+	return string;
+}
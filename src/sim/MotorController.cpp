@@ -0,0 +1,281 @@
+// Simulated Wheelwriter motor controller
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+#include "MotorController.h"
+#include "Wheelwriter.h"
+#include <map>
+
+using namespace sim;
+using namespace wheelwriter;
+
+MotorController::MotorController() : model_(WHEELWRITER_3), wheel_(CPI_12), state_(IDLE), command_(0),
+                                     wheelFree_(0), hammerFree_(0), carriageFree_(0), platenFree_(0),
+                                     lastStart_(0), wheelPosition_(0), repeatMode_(0), x_(0), y_(0) {
+	data_[0] = 0;
+	data_[1] = 0;
+}
+
+void MotorController::receive(Bus& bus, uint16_t word, uint64_t time) {
+	if (word & WW_ADDRESS_BIT) {
+		if ((word & 0xff) == ADDRESS) {
+			state_ = COMMAND;
+			bus.transmit(0, time + timing_.turnaround, false);
+		}
+		else {
+			state_ = IDLE;
+		}
+		return;
+	}
+
+	uint8_t length = (command_ < 16) ? ww_command_length[command_] : 0;
+	switch (state_) {
+		case IDLE:
+			return;
+		case COMMAND:
+			command_ = word & 0xff;
+			length = (command_ < 16) ? ww_command_length[command_] : 0;
+			state_ = DATA1;
+			break;
+		case DATA1:
+			data_[0] = word & 0xff;
+			state_ = DATA2;
+			break;
+		case DATA2:
+			data_[1] = word & 0xff;
+			state_ = IDLE;
+			break;
+	}
+	// Parts received so far, including the command
+	uint8_t parts = (state_ == DATA1) ? 1 : (state_ == DATA2) ? 2 : 3;
+	if (parts < length) {
+		bus.transmit(0, time + timing_.turnaround, false);
+		return;
+	}
+
+	state_ = IDLE;
+	stats_.commands[command_ & 0x0f]++;
+	uint64_t replyTime;
+	uint16_t reply = execute(time, replyTime);
+	bus.transmit(reply, replyTime, false);
+}
+
+uint16_t MotorController::execute(uint64_t time, uint64_t& replyTime) {
+	uint64_t accept = time + timing_.turnaround;
+	replyTime = accept;
+	switch (command_) {
+		case QUERY_MODEL:
+			return model_;
+		case QUERY_WHEEL:
+			return wheel_;
+		case QUERY_STATUS:
+			return status(time);
+		case SET_REPEAT_MODE:
+			repeatMode_ = data_[0];
+			return 0;
+		case RESET: {
+			// The reply is held back until the carriage is home
+			uint64_t start = later(accept, idleTime());
+			uint64_t end = start + timing_.reset;
+			stats_.carriageTravel += x_;
+			x_ = 0;
+			wheelPosition_ = 0;
+			repeatMode_ = REPEAT_OFF;
+			wheelFree_ = hammerFree_ = carriageFree_ = platenFree_ = end;
+			lastStart_ = start;
+			replyTime = end;
+			return wheel_;
+		}
+		case TYPE_CHARACTER_NO_ADVANCE:
+		case TYPE_CHARACTER_AND_ADVANCE:
+		case ERASE_CHARACTER_AND_ADVANCE:
+		case MOVE_PLATEN:
+		case MOVE_CARRIAGE:
+		case SPIN_WHEEL:
+			break;
+		default:
+			// Settings - nothing to move
+			return 0;
+	}
+
+	// Motion - hold the ACK while the previous command is still waiting
+	if (lastStart_ > accept) {
+		stats_.stalls++;
+		stats_.stallTime += lastStart_ - accept;
+		accept = lastStart_;
+		replyTime = accept;
+	}
+	switch (command_) {
+		case TYPE_CHARACTER_NO_ADVANCE:
+			lastStart_ = strike(accept, data_[0], 0, false);
+			break;
+		case TYPE_CHARACTER_AND_ADVANCE:
+			lastStart_ = strike(accept, data_[0], data_[1], false);
+			break;
+		case ERASE_CHARACTER_AND_ADVANCE:
+			lastStart_ = strike(accept, data_[0], data_[1], true);
+			break;
+		case MOVE_PLATEN:
+			lastStart_ = movePlaten(accept, data_[0] & PLATEN_DIRECTION_UP, data_[0] & 0x7f);
+			break;
+		case MOVE_CARRIAGE:
+			lastStart_ = moveCarriage(accept, data_[0] & CARRIAGE_DIRECTION_RIGHT, ((data_[0] & 0x07) << 8) | data_[1]);
+			break;
+		case SPIN_WHEEL: {
+			uint64_t start = later(accept, later(wheelFree_, hammerFree_));
+			wheelFree_ = hammerFree_ = start + timing_.spinWheel;
+			wheelPosition_ = 0;
+			lastStart_ = start;
+			break;
+		}
+	}
+	return 0;
+}
+
+uint64_t MotorController::strike(uint64_t time, uint8_t position, uint8_t advance, bool erase) {
+	uint64_t start = later(time, later(wheelFree_, hammerFree_));
+	// Position 0 is a space - there is nothing to strike
+	if (position) {
+		hit(time, position, erase);
+	}
+	else if (!(repeatMode_ & UNDERLINE)) {
+		return moveCarriage(time, true, advance);
+	}
+	// In underline mode the controller follows every character, spaces included, with an underscore
+	if ((repeatMode_ & UNDERLINE) && !erase) {
+		hit(time, WW_UNDERSCORE_POSITION, false);
+	}
+	if (advance) {
+		moveCarriage(hammerFree_, true, advance);
+	}
+	return start;
+}
+
+uint64_t MotorController::hit(uint64_t time, uint8_t position, bool erase) {
+	// Positions run 1-96 round the wheel
+	uint8_t distance = (position + WHEEL_POSITIONS - wheelPosition_) % WHEEL_POSITIONS;
+	if (distance > WHEEL_POSITIONS / 2) {
+		distance = WHEEL_POSITIONS - distance;
+	}
+	uint64_t start = later(time, later(wheelFree_, hammerFree_));
+	uint64_t strikeTime = later(start + (uint64_t)distance * timing_.wheelPerPosition,
+	                            later(carriageFree_, platenFree_));
+	uint64_t end = strikeTime + timing_.hammer + (erase ? timing_.erase : 0);
+	wheelFree_ = hammerFree_ = end;
+	wheelPosition_ = position;
+	stats_.wheelTravel += distance;
+
+	Strike record;
+	record.time = strikeTime;
+	record.x = x_;
+	record.y = y_;
+	record.position = position;
+	record.erase = erase;
+	strikes_.push_back(record);
+	if (erase) {
+		stats_.erases++;
+	}
+	else {
+		stats_.strikes++;
+		if (repeatMode_ & WW_IMPRESSION_MASK) {
+			stats_.heavyStrikes++;
+		}
+	}
+	return end;
+}
+
+uint64_t MotorController::moveCarriage(uint64_t time, bool right, uint16_t usteps) {
+	uint64_t start = later(time, later(carriageFree_, hammerFree_));
+	int32_t target = right ? x_ + usteps : x_ - usteps;
+	// The carriage stops at either end
+	if (target < 0) {
+		target = 0;
+	}
+	if (target > CARRIAGE_MAX) {
+		target = CARRIAGE_MAX;
+	}
+	uint32_t travel = (target > x_) ? target - x_ : x_ - target;
+	if (travel) {
+		carriageFree_ = start + timing_.carriageBase + (uint64_t)travel * timing_.carriagePerUstep;
+	}
+	x_ = target;
+	stats_.carriageTravel += travel;
+	return start;
+}
+
+uint64_t MotorController::movePlaten(uint64_t time, bool up, uint8_t usteps) {
+	uint64_t start = later(time, later(platenFree_, hammerFree_));
+	// Moving the paper up moves the print position down the page
+	y_ += up ? usteps : -(int32_t)usteps;
+	if (usteps) {
+		platenFree_ = start + timing_.platenBase + (uint64_t)usteps * timing_.platenPerUstep;
+	}
+	stats_.platenTravel += usteps;
+	return start;
+}
+
+uint8_t MotorController::status(uint64_t time) const {
+	if ((wheelFree_ > time) || (hammerFree_ > time) || (carriageFree_ > time)) {
+		return CARRIAGE_MOTION_COMPLETE;
+	}
+	if (platenFree_ > time) {
+		return PAPER_DOWN;
+	}
+	return NO_STATUS;
+}
+
+uint64_t MotorController::idleTime() const {
+	return later(later(wheelFree_, hammerFree_), later(carriageFree_, platenFree_));
+}
+
+static int32_t floorDiv(int32_t a, int32_t b) {
+	return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+static void appendUtf8(std::string& out, uint8_t c) {
+	if (c < 0x80) {
+		out += (char)c;
+	}
+	else {
+		out += (char)(0xc0 | (c >> 6));
+		out += (char)(0x80 | (c & 0x3f));
+	}
+}
+
+std::string MotorController::renderPage(uint16_t cellWidth, uint16_t lineHeight) const {
+	std::map<int32_t, std::map<int32_t, uint8_t>> page;
+	for (const Strike& strike : strikes_) {
+		int32_t row = floorDiv(strike.y, lineHeight);
+		int32_t column = floorDiv(strike.x, cellWidth);
+		if (strike.erase) {
+			page[row].erase(column);
+			continue;
+		}
+		uint8_t c = (strike.position < WW_PRINTWHEEL_POSITIONS) ? ww_printwheel_unicode_us[strike.position] : '?';
+		std::map<int32_t, uint8_t>& line = page[row];
+		// An underline keeps the character underneath
+		if ((c == '_') && line.count(column)) {
+			continue;
+		}
+		line[column] = c;
+	}
+
+	std::string out;
+	if (page.empty()) {
+		return out;
+	}
+	for (int32_t row = page.begin()->first; row <= page.rbegin()->first; row++) {
+		std::map<int32_t, std::map<int32_t, uint8_t>>::const_iterator line = page.find(row);
+		if (line != page.end()) {
+			int32_t column = 0;
+			for (const std::pair<const int32_t, uint8_t>& cell : line->second) {
+				for (; column < cell.first; column++) {
+					out += ' ';
+				}
+				appendUtf8(out, cell.second);
+				column++;
+			}
+		}
+		out += '\n';
+	}
+	return out;
+}
@@ -0,0 +1,135 @@
+// Simulated Wheelwriter motor controller
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+// Models the controller at 0x21 on the option bus: it ACKs each word of a
+// command, answers the model/wheel/status queries, and runs the printwheel,
+// hammer, carriage and platen with fixed durations. Characters struck are
+// recorded so the page can be rendered as text afterwards.
+//
+// The controller holds one command while the mechanism is busy. The ACK to
+// the last byte of a motion command is held back until the command before it
+// has started, which is what throttles the host. Queries are answered at once.
+//
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "SimBus.h"
+
+namespace sim {
+
+// Durations in microseconds
+struct MotorTiming {
+	uint32_t turnaround = 25;        // From the end of a word to the start of the reply
+	uint32_t wheelPerPosition = 1000; // Printwheel rotation, per petal (shortest way round)
+	uint32_t hammer = 35000;         // Strike and hammer return
+	uint32_t erase = 20000;          // Extra for lifting the correction tape
+	uint32_t carriageBase = 8000;    // Carriage acceleration and settling
+	uint32_t carriagePerUstep = 60;
+	uint32_t platenBase = 8000;
+	uint32_t platenPerUstep = 500;
+	uint32_t spinWheel = 700000;
+	uint32_t reset = 1500000;
+};
+
+struct Strike {
+	uint64_t time;
+	int32_t x;          // Carriage position in microspaces
+	int32_t y;          // Platen position in microspaces, increasing down the page
+	uint8_t position;   // Printwheel position
+	bool erase;
+};
+
+struct MotorStats {
+	uint64_t commands[16] = {};
+	uint64_t strikes = 0;
+	uint64_t erases = 0;
+	uint64_t heavyStrikes = 0;    // Struck at the heavy impression (0x09 bit 0)
+	uint64_t wheelTravel = 0;     // Petals
+	uint64_t carriageTravel = 0;  // Microspaces
+	uint64_t platenTravel = 0;
+	uint64_t stalls = 0;          // ACKs held back while the controller was full
+	uint64_t stallTime = 0;
+};
+
+class MotorController : public BusDevice {
+public:
+	static const uint8_t ADDRESS = 0x21;
+	static const uint8_t WHEEL_POSITIONS = 96;
+	// Right stop of the carriage, in microspaces (1/120")
+	static const int32_t CARRIAGE_MAX = 1320;
+
+	MotorController();
+	void receive(Bus& bus, uint16_t word, uint64_t time) override;
+
+	void setModel(uint8_t model) {
+		model_ = model;
+	}
+	void setWheel(uint8_t wheel) {
+		wheel_ = wheel;
+	}
+	MotorTiming& timing() {
+		return timing_;
+	}
+	const MotorStats& stats() const {
+		return stats_;
+	}
+	const std::vector<Strike>& strikes() const {
+		return strikes_;
+	}
+	// Time the mechanism comes to rest after everything accepted so far
+	uint64_t idleTime() const;
+
+	// Renders the struck characters as lines of UTF-8 text, one cell per
+	// cellWidth microspaces and one line per lineHeight microspaces
+	std::string renderPage(uint16_t cellWidth=10, uint16_t lineHeight=16) const;
+
+private:
+	enum State {
+		IDLE,       // Waiting for our address
+		COMMAND,
+		DATA1,
+		DATA2,
+	};
+
+	// Runs the command and returns the reply to its last byte, setting when
+	// it should be sent
+	uint16_t execute(uint64_t time, uint64_t& replyTime);
+	// Each returns the time the motion starts
+	uint64_t strike(uint64_t time, uint8_t position, uint8_t advance, bool erase);
+	// Turns the wheel to a position and strikes it. Returns the time the hammer is free.
+	uint64_t hit(uint64_t time, uint8_t position, bool erase);
+	uint64_t moveCarriage(uint64_t time, bool right, uint16_t usteps);
+	uint64_t movePlaten(uint64_t time, bool up, uint8_t usteps);
+	uint8_t status(uint64_t time) const;
+	static uint64_t later(uint64_t a, uint64_t b) {
+		return (a > b) ? a : b;
+	}
+
+	MotorTiming timing_;
+	MotorStats stats_;
+	uint8_t model_;
+	uint8_t wheel_;
+
+	State state_;
+	uint8_t command_;
+	uint8_t data_[2];
+
+	// When each part of the mechanism is next free
+	uint64_t wheelFree_;
+	uint64_t hammerFree_;
+	uint64_t carriageFree_;
+	uint64_t platenFree_;
+	// Start of the last command accepted
+	uint64_t lastStart_;
+
+	uint8_t wheelPosition_;
+	uint8_t repeatMode_;  // Set by command 0x09
+	int32_t x_;
+	int32_t y_;
+	std::vector<Strike> strikes_;
+};
+
+} // namespace sim
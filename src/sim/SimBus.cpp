@@ -0,0 +1,37 @@
+// Simulated Wheelwriter bus
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+#include "SimBus.h"
+
+using namespace sim;
+
+Bus& Bus::shared() {
+	static Bus bus;
+	return bus;
+}
+void Bus::attach(BusDevice* device) {
+	devices_.push_back(device);
+}
+uint64_t Bus::transmit(uint16_t word, uint64_t start, bool host) {
+	if (start < lineFree_) {
+		start = lineFree_;
+	}
+	Frame frame;
+	frame.end = frameTime(start);
+	frame.word = word;
+	frame.host = host;
+	frames_.push_back(frame);
+	lineFree_ = frame.end;
+
+	if (host) {
+		hostWords_++;
+		for (BusDevice* device : devices_) {
+			device->receive(*this, word, frame.end);
+		}
+	}
+	else {
+		deviceWords_++;
+	}
+	return frame.end;
+}
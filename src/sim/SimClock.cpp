@@ -0,0 +1,50 @@
+// Virtual clock for the host-side simulator
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+#include "SimClock.h"
+#include <time.h>
+
+static uint64_t now_ = 0;
+static double pace_ = 0;
+// Virtual and wall clock times when pacing started
+static uint64_t paceStart_ = 0;
+static uint64_t wallStart_ = 0;
+
+// Sleep once the clock is this far ahead of the wall clock
+static const uint64_t PACE_SLACK_US = 1000;
+
+static uint64_t wallTime() {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (uint64_t)time.tv_sec * 1000000 + time.tv_nsec / 1000;
+}
+static void pace() {
+	if (pace_ <= 0) return;
+	uint64_t wall = wallTime() - wallStart_;
+	uint64_t due = (uint64_t)((now_ - paceStart_) / pace_);
+	if (due > wall + PACE_SLACK_US) {
+		uint64_t sleep = due - wall;
+		struct timespec time = {(time_t)(sleep / 1000000), (long)(sleep % 1000000) * 1000};
+		nanosleep(&time, NULL);
+	}
+}
+
+uint64_t sim::now() {
+	return now_;
+}
+void sim::advance(uint64_t us) {
+	now_ += us;
+	pace();
+}
+void sim::advanceTo(uint64_t time) {
+	if (time > now_) {
+		now_ = time;
+		pace();
+	}
+}
+void sim::setPace(double speed) {
+	pace_ = speed;
+	paceStart_ = now_;
+	wallStart_ = wallTime();
+}
@@ -0,0 +1,7 @@
+// WiFiNINA stand-in for building the sketch on a Linux host
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+#include "WiFiNINA.h"
+
+WiFiClass WiFi;
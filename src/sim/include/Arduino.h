@@ -0,0 +1,157 @@
+// Minimal Arduino API for building the sketch sources on a Linux host
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+// Only what the Wheelwriter sources use is provided. Time comes from the
+// simulator's virtual clock (see SimClock.h). Serial writes to a file
+// descriptor, stdout by default, and reads from another if one is set.
+//
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <deque>
+#include "SimClock.h"
+#include "WString.h"
+
+#define HEX 16
+#define DEC 10
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+
+typedef uint8_t byte;
+
+// Reading the clock takes a microsecond, so loops that spin on it end
+inline unsigned long millis() {
+	sim::advance(1);
+	return sim::now() / 1000;
+}
+inline unsigned long micros() {
+	sim::advance(1);
+	return sim::now();
+}
+inline void delay(unsigned long ms) {
+	sim::advance((uint64_t)ms * 1000);
+}
+inline void delayMicroseconds(unsigned int us) {
+	sim::advance(us);
+}
+inline void pinMode(uint8_t pin, uint8_t mode) {}
+inline void digitalWrite(uint8_t pin, uint8_t value) {}
+
+// Pico SDK calls made by the sketch
+typedef struct pio_hw* PIO;
+#define pio0 ((PIO)0)
+#define pio1 ((PIO)1)
+enum gpio_drive_strength {
+	GPIO_DRIVE_STRENGTH_2MA,
+	GPIO_DRIVE_STRENGTH_4MA,
+	GPIO_DRIVE_STRENGTH_8MA,
+	GPIO_DRIVE_STRENGTH_12MA
+};
+inline void gpio_set_drive_strength(uint gpio, gpio_drive_strength drive) {}
+inline uint32_t time_us_32() {
+	return (uint32_t)sim::now();
+}
+
+class HostSerial {
+public:
+	// Bytes buffered on our side, as in the USB CDC driver. Beyond this the
+	// sender is held off by the file descriptor.
+	static const size_t RX_BUFFER_SIZE = 256;
+	// Virtual time that passes each time the input is polled and found empty
+	static const uint32_t POLL_US = 20;
+
+	HostSerial() : in_(-1), out_(1), timeout_(1000), pollHook_(NULL) {}
+	void begin(unsigned long baud) {}
+	void setInput(int fd) {
+		in_ = fd;
+	}
+	void setOutput(int fd) {
+		out_ = fd;
+	}
+	// Called whenever the input is polled and found empty
+	void setPollHook(void (*hook)()) {
+		pollHook_ = hook;
+	}
+	void setTimeout(unsigned long timeout) {
+		timeout_ = timeout;
+	}
+	operator bool() {
+		return true;
+	}
+
+	size_t write(uint8_t byte) {
+		return write(&byte, 1);
+	}
+	size_t write(const char* string) {
+		return write((const uint8_t*)string, strlen(string));
+	}
+	size_t write(const uint8_t* buffer, size_t size);
+	size_t write(const char* buffer, size_t size) {
+		return write((const uint8_t*)buffer, size);
+	}
+
+	size_t print(const char* string) {
+		return write(string);
+	}
+	size_t print(const String& string) {
+		return write(string.c_str());
+	}
+	size_t print(char c) {
+		return write((uint8_t)c);
+	}
+	size_t print(long value, int base=DEC);
+	size_t print(unsigned long value, int base=DEC);
+	size_t print(int value, int base=DEC) {
+		return print((long)value, base);
+	}
+	size_t print(unsigned int value, int base=DEC) {
+		return print((unsigned long)value, base);
+	}
+	size_t print(double value, int decimals=2) {
+		return print(String(value, decimals));
+	}
+	template <typename T>
+	size_t println(const T& value) {
+		return print(value) + write("\r\n");
+	}
+	template <typename T>
+	size_t println(const T& value, int base) {
+		return print(value, base) + write("\r\n");
+	}
+	size_t println() {
+		return write("\r\n");
+	}
+
+	int available();
+	int read();
+	int peek();
+	size_t readBytes(uint8_t* buffer, size_t length);
+	size_t readBytes(char* buffer, size_t length) {
+		return readBytes((uint8_t*)buffer, length);
+	}
+	size_t readBytesUntil(char terminator, char* buffer, size_t length);
+	String readStringUntil(char terminator);
+
+private:
+	// Reads whatever has arrived on the input, up to the buffer size
+	void fill();
+	// Waits up to the timeout for a byte
+	int timedRead();
+
+	int in_;
+	int out_;
+	unsigned long timeout_;
+	void (*pollHook_)();
+	std::deque<uint8_t> rxBuffer_;
+};
+
+extern HostSerial Serial;
@@ -0,0 +1,35 @@
+// mbed FlashIAP stand-in for building the sketch on a Linux host
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+// Describes a 2 MB flash with the sketch in the first half, like the Nano
+// RP2040 Connect's 16 MB but smaller. See FlashIAPBlockDevice.h.
+//
+#pragma once
+
+#include <stdint.h>
+
+#define FLASHIAP_APP_ROM_END_ADDR 0x10100000
+
+namespace mbed {
+
+class FlashIAP {
+public:
+	int init() {
+		return 0;
+	}
+	int deinit() {
+		return 0;
+	}
+	uint32_t get_sector_size(uint32_t address) const {
+		return 4096;
+	}
+	uint32_t get_flash_start() const {
+		return 0x10000000;
+	}
+	uint32_t get_flash_size() const {
+		return 0x200000;
+	}
+};
+
+} // namespace mbed
@@ -0,0 +1,57 @@
+// mbed FlashIAPBlockDevice stand-in for building the sketch on a Linux host
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+// Held in memory, so parameters stored to flash last until the program exits.
+//
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <memory>
+#include <vector>
+
+namespace mbed {
+
+class FlashIAPBlockDevice {
+public:
+	FlashIAPBlockDevice(uint32_t address, uint32_t size) : flash_(size, 0xff) {}
+	int init() {
+		return 0;
+	}
+	int deinit() {
+		return 0;
+	}
+	int read(void* buffer, uint64_t address, uint64_t size) {
+		if (address + size > flash_.size()) return -1;
+		memcpy(buffer, flash_.data() + address, size);
+		return 0;
+	}
+	int program(const void* buffer, uint64_t address, uint64_t size) {
+		if (address + size > flash_.size()) return -1;
+		memcpy(flash_.data() + address, buffer, size);
+		return 0;
+	}
+	int erase(uint64_t address, uint64_t size) {
+		if (address + size > flash_.size()) return -1;
+		memset(flash_.data() + address, 0xff, size);
+		return 0;
+	}
+	uint64_t size() const {
+		return flash_.size();
+	}
+	uint64_t get_read_size() const {
+		return 1;
+	}
+	uint64_t get_program_size() const {
+		return 256;
+	}
+	uint64_t get_erase_size() const {
+		return 4096;
+	}
+
+private:
+	std::vector<uint8_t> flash_;
+};
+
+} // namespace mbed
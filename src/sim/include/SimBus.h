@@ -0,0 +1,74 @@
+// Simulated Wheelwriter bus
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+// The bus is a single half-duplex line. Each word is a frame with a fixed
+// duration (start bit, 9 data bits, stop bit at 187.5 kbaud). Frames never
+// overlap - a transmission starts once the line is free. Devices are handed
+// every word the host sends as soon as it is transmitted, and schedule their
+// replies on the line in response.
+//
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+namespace sim {
+
+class Bus;
+
+struct Frame {
+	uint64_t end;   // Time at the end of the stop bit
+	uint16_t word;
+	bool host;      // Sent by the interface board
+};
+
+class BusDevice {
+public:
+	virtual ~BusDevice() {}
+	// Called with each word the host sends, at the end of its stop bit
+	virtual void receive(Bus& bus, uint16_t word, uint64_t time) = 0;
+};
+
+class Bus {
+public:
+	static const uint32_t BAUD = 187500;
+	static const uint32_t FRAME_BITS = 11;
+	// Frame duration in nanoseconds
+	static const uint64_t FRAME_NS = (uint64_t)FRAME_BITS * 1000000000 / BAUD;
+
+	Bus() : lineFree_(0), hostWords_(0), deviceWords_(0) {}
+	void attach(BusDevice* device);
+	// The bus the sketch's UART is on when it is initialized as on the board
+	static Bus& shared();
+
+	// Puts a word on the line, starting no earlier than start (microseconds).
+	// Returns the time at the end of its stop bit.
+	uint64_t transmit(uint16_t word, uint64_t start, bool host);
+
+	// Frames on the line, oldest first. The host UART removes them as it reads.
+	std::deque<Frame>& frames() {
+		return frames_;
+	}
+	static uint64_t frameTime(uint64_t start) {
+		// Rounded up, so back-to-back frames never end up overlapping
+		return start + (FRAME_NS + 999) / 1000;
+	}
+
+	uint64_t hostWords() {
+		return hostWords_;
+	}
+	uint64_t deviceWords() {
+		return deviceWords_;
+	}
+
+private:
+	std::vector<BusDevice*> devices_;
+	std::deque<Frame> frames_;
+	uint64_t lineFree_;
+	uint64_t hostWords_;
+	uint64_t deviceWords_;
+};
+
+} // namespace sim
@@ -0,0 +1,30 @@
+// Virtual clock for the host-side simulator
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+// Time only moves when the code under test waits: delay() calls advance it,
+// polling the simulated bus with nothing to read jumps it to the next word on
+// the line, and each millis()/micros() call takes a microsecond, so loops
+// that spin on the clock finish. Hours of typing run in however long the CPU
+// takes.
+//
+// When the simulation talks to something outside it in real time, such as a
+// client on a pty, the clock can be paced so it never runs ahead of the wall
+// clock (scaled by a speed factor).
+//
+#pragma once
+
+#include <stdint.h>
+
+namespace sim {
+
+// Microseconds since the start of the simulation
+uint64_t now();
+void advance(uint64_t us);
+// Never moves the clock backwards
+void advanceTo(uint64_t time);
+// Keeps the clock within speed times the wall clock, sleeping as needed.
+// 0 runs as fast as possible.
+void setPace(double speed);
+
+} // namespace sim
@@ -0,0 +1,242 @@
+// Simulated 9-bit UART for the host-side simulator
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+// Stands in for uart_9bit/Uart9Bit.h when built with WHEELWRITER_SIM, with the
+// same API on top of a simulated bus. Words we transmit are echoed back, as on
+// the real half-duplex line, unless echo masking is on, in which case replies
+// come back tagged with the word they answer (see Uart9Bit.h).
+//
+// Polling with nothing to read moves the virtual clock on, up to the next word
+// on the line, so wait loops finish as soon as the reply would have arrived.
+//
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <deque>
+#include <Arduino.h>
+#include "SimBus.h"
+#include "SimClock.h"
+
+class Uart9Bit {
+public:
+	static const uint32_t TAG_WORD_MASK = 0x1ff;
+	static const uint32_t TAG_STOP = 1u << 9;
+	static const uint32_t TAG_REPLY_SHIFT = 10;
+	static const uint32_t TAG_REPLY_STOP = 1u << 19;
+	static const uint32_t TAG_REPLY = 1u << 20;
+
+	// Furthest the clock moves when polled with nothing to read
+	static const uint64_t IDLE_STEP_US = 100;
+	// A blocking read that waits longer than this would hang the real board
+	static const uint64_t HANG_US = 10000000;
+
+	static uint16_t taggedWord(uint32_t tagged) {
+		return tagged & TAG_WORD_MASK;
+	}
+	static uint16_t taggedReply(uint32_t tagged) {
+		return (tagged >> TAG_REPLY_SHIFT) & TAG_WORD_MASK;
+	}
+	static bool taggedIsReply(uint32_t tagged) {
+		return tagged & TAG_REPLY;
+	}
+	static bool taggedFramingError(uint32_t tagged) {
+		return !(tagged & TAG_STOP) || (taggedIsReply(tagged) && !(tagged & TAG_REPLY_STOP));
+	}
+
+	Uart9Bit() : bus_(NULL), echoMasked_(false), dma_(false), echoPending_(false) {}
+	void init(sim::Bus* bus) {
+		bus_ = bus;
+	}
+	// Same call as the hardware UART - connects to the shared bus
+	void init(PIO pio, uint sm_tx, uint pin_tx, uint sm_rx, uint pin_rx, uint baud) {
+		init(&sim::Bus::shared());
+	}
+	void enableDma() {
+		dma_ = true;
+	}
+	bool dmaEnabled() {
+		return dma_;
+	}
+	void setEchoMasked(bool masked) {
+		if (masked == echoMasked_) return;
+		echoMasked_ = masked;
+		discard();
+	}
+	bool echoMasked() {
+		return echoMasked_;
+	}
+
+	void write(uint16_t word) {
+		if (!bus_) return;
+		bus_->transmit(word, sim::now(), true);
+	}
+	void write(const uint16_t* buffer, unsigned count) {
+		for (unsigned i = 0; i < count; i++) {
+			write(buffer[i]);
+		}
+	}
+	uint16_t read() {
+		uint32_t timestamp;
+		return read(timestamp);
+	}
+	uint16_t read(uint32_t& timestamp) {
+		return untag(readTagged(timestamp));
+	}
+	uint32_t readTagged() {
+		uint32_t timestamp;
+		return readTagged(timestamp);
+	}
+	uint32_t readTagged(uint32_t& timestamp) {
+		uint64_t start = sim::now();
+		while (!available()) {
+			if ((sim::now() - start) > HANG_US) {
+				fprintf(stderr, "Uart9Bit: blocking read with nothing on the bus - the board would hang here\n");
+				abort();
+			}
+		}
+		Record record = records_.front();
+		records_.pop_front();
+		timestamp = (uint32_t)record.time;
+		return record.tagged;
+	}
+	bool available() {
+		if (ready()) {
+			return true;
+		}
+		idle();
+		return false;
+	}
+
+	bool waitAvailable(uint32_t timeout_us) {
+		uint64_t start = sim::now();
+		while (!available()) {
+			if ((sim::now() - start) >= timeout_us) {
+				return false;
+			}
+		}
+		return true;
+	}
+	bool read(uint16_t& word, uint32_t timeout_us) {
+		if (!waitAvailable(timeout_us)) return false;
+		word = read();
+		return true;
+	}
+	bool readTagged(uint32_t& tagged, uint32_t timeout_us) {
+		if (!waitAvailable(timeout_us)) return false;
+		tagged = readTagged();
+		return true;
+	}
+	void restartRx() {
+		discard();
+	}
+
+	// DMA API - the simulated FIFOs never fill, so these just pass through
+	unsigned writeAsync(const uint16_t* buffer, unsigned count) {
+		write(buffer, count);
+		return count;
+	}
+	unsigned readAvailable(uint16_t* buffer, unsigned count) {
+		return readAvailable(buffer, NULL, count);
+	}
+	unsigned readAvailable(uint16_t* buffer, uint32_t* timestamps, unsigned count) {
+		unsigned i = 0;
+		for (; (i < count) && ready(); i++) {
+			uint32_t timestamp;
+			buffer[i] = read(timestamp);
+			if (timestamps) {
+				timestamps[i] = timestamp;
+			}
+		}
+		return i;
+	}
+	unsigned readAvailableTagged(uint32_t* buffer, uint32_t* timestamps, unsigned count) {
+		unsigned i = 0;
+		for (; (i < count) && ready(); i++) {
+			uint32_t timestamp;
+			buffer[i] = readTagged(timestamp);
+			if (timestamps) {
+				timestamps[i] = timestamp;
+			}
+		}
+		return i;
+	}
+	uint32_t rxAvailable() {
+		ready();
+		return records_.size();
+	}
+	uint32_t txPending() {
+		return 0;
+	}
+	bool txIdle() {
+		return true;
+	}
+	bool rxOverrun() {
+		return false;
+	}
+
+private:
+	struct Record {
+		uint64_t time;
+		uint32_t tagged;
+	};
+
+	static uint16_t untag(uint32_t tagged) {
+		return taggedIsReply(tagged) ? taggedReply(tagged) : taggedWord(tagged);
+	}
+	// Moves words that have finished arriving off the line, as the RX state
+	// machine would. Returns true if there is something to read.
+	bool ready() {
+		if (!bus_) return false;
+		std::deque<sim::Frame>& frames = bus_->frames();
+		while (!frames.empty() && (frames.front().end <= sim::now())) {
+			sim::Frame frame = frames.front();
+			frames.pop_front();
+			if (!echoMasked_) {
+				records_.push_back({frame.end, frame.word | TAG_STOP});
+			}
+			else if (frame.host) {
+				// Held until the reply comes in - an unanswered word is dropped
+				echoPending_ = true;
+				echo_ = frame.word;
+			}
+			else if (echoPending_) {
+				echoPending_ = false;
+				records_.push_back({frame.end, echo_ | TAG_STOP | ((uint32_t)frame.word << TAG_REPLY_SHIFT) |
+				                               TAG_REPLY_STOP | TAG_REPLY});
+			}
+			else {
+				records_.push_back({frame.end, frame.word | TAG_STOP});
+			}
+		}
+		return !records_.empty();
+	}
+	// Nothing to read - wait a step, or less if the next word is in by then
+	void idle() {
+		uint64_t next = sim::now() + IDLE_STEP_US;
+		if (bus_ && !bus_->frames().empty() && (bus_->frames().front().end < next)) {
+			next = bus_->frames().front().end;
+		}
+		sim::advanceTo(next);
+	}
+	// Drops everything received so far, including words still arriving
+	void discard() {
+		ready();
+		records_.clear();
+		echoPending_ = false;
+		if (!bus_) return;
+		std::deque<sim::Frame>& frames = bus_->frames();
+		while (!frames.empty() && (frames.front().end - sim::Bus::frameTime(0) < sim::now())) {
+			frames.pop_front();
+		}
+	}
+
+	sim::Bus* bus_;
+	bool echoMasked_;
+	bool dma_;
+	std::deque<Record> records_;
+	bool echoPending_;
+	uint16_t echo_;
+};
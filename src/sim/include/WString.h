@@ -0,0 +1,98 @@
+// Minimal Arduino String for building the sketch on a Linux host
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
+
+class String {
+public:
+	String() {}
+	String(const char* string) : string_(string ? string : "") {}
+	String(const std::string& string) : string_(string) {}
+	String(char c) : string_(1, c) {}
+	String(int value) : string_(std::to_string(value)) {}
+	String(unsigned int value) : string_(std::to_string(value)) {}
+	String(long value) : string_(std::to_string(value)) {}
+	String(unsigned long value) : string_(std::to_string(value)) {}
+	String(double value, unsigned char decimals=2) {
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+		string_ = buffer;
+	}
+
+	const char* c_str() const {
+		return string_.c_str();
+	}
+	unsigned int length() const {
+		return string_.length();
+	}
+	char operator[](unsigned int index) const {
+		return (index < string_.length()) ? string_[index] : 0;
+	}
+	char& operator[](unsigned int index) {
+		return string_[index];
+	}
+	void toLowerCase() {
+		for (char& c : string_) {
+			c = tolower(c);
+		}
+	}
+	void toUpperCase() {
+		for (char& c : string_) {
+			c = toupper(c);
+		}
+	}
+	long toInt() const {
+		return atol(string_.c_str());
+	}
+	void toCharArray(char* buffer, unsigned int size) const {
+		if (!size) return;
+		size_t count = string_.copy(buffer, size - 1);
+		buffer[count] = '\0';
+	}
+	void trim() {
+		size_t start = string_.find_first_not_of(" \t\r\n");
+		size_t end = string_.find_last_not_of(" \t\r\n");
+		string_ = (start == std::string::npos) ? "" : string_.substr(start, end - start + 1);
+	}
+
+	String& operator+=(const String& other) {
+		string_ += other.string_;
+		return *this;
+	}
+	String& operator+=(const char* other) {
+		string_ += other;
+		return *this;
+	}
+	String& operator+=(char c) {
+		string_ += c;
+		return *this;
+	}
+	friend String operator+(const String& a, const String& b) {
+		return String(a.string_ + b.string_);
+	}
+	friend String operator+(const String& a, const char* b) {
+		return String(a.string_ + b);
+	}
+	friend String operator+(const char* a, const String& b) {
+		return String(a + b.string_);
+	}
+	bool operator==(const String& other) const {
+		return string_ == other.string_;
+	}
+	bool operator!=(const String& other) const {
+		return string_ != other.string_;
+	}
+	bool operator<(const String& other) const {
+		return string_ < other.string_;
+	}
+
+private:
+	std::string string_;
+};
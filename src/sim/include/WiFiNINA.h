@@ -0,0 +1,126 @@
+// WiFiNINA stand-in for building the sketch on a Linux host
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+// There is no WiFi module: scans find nothing, connecting fails and the
+// server never has a client, so the REST API stays idle.
+//
+#pragma once
+
+#include <Arduino.h>
+
+#define WIFI_FIRMWARE_LATEST_VERSION "1.5.0"
+
+enum wl_status_t {
+	WL_NO_SHIELD = 255,
+	WL_NO_MODULE = WL_NO_SHIELD,
+	WL_IDLE_STATUS = 0,
+	WL_NO_SSID_AVAIL,
+	WL_SCAN_COMPLETED,
+	WL_CONNECTED,
+	WL_CONNECT_FAILED,
+	WL_CONNECTION_LOST,
+	WL_DISCONNECTED
+};
+
+enum wl_enc_type {
+	ENC_TYPE_WEP = 5,
+	ENC_TYPE_TKIP = 2,
+	ENC_TYPE_CCMP = 4,
+	ENC_TYPE_NONE = 7,
+	ENC_TYPE_AUTO = 8,
+	ENC_TYPE_UNKNOWN = 255
+};
+
+class IPAddress {
+public:
+	IPAddress() : address_{0, 0, 0, 0} {}
+	operator String() const {
+		char buffer[16];
+		snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", address_[0], address_[1], address_[2], address_[3]);
+		return String(buffer);
+	}
+private:
+	uint8_t address_[4];
+};
+
+class WiFiClient {
+public:
+	operator bool() {
+		return false;
+	}
+	uint8_t connected() {
+		return 0;
+	}
+	int available() {
+		return 0;
+	}
+	int read() {
+		return -1;
+	}
+	int read(uint8_t* buffer, size_t size) {
+		return -1;
+	}
+	size_t print(const char* string) {
+		return strlen(string);
+	}
+	size_t println(const char* string="") {
+		return strlen(string) + 2;
+	}
+	size_t write(const uint8_t* buffer, size_t size) {
+		return size;
+	}
+	void stop() {}
+};
+
+class WiFiServer {
+public:
+	WiFiServer(uint16_t port) {}
+	void begin() {}
+	WiFiClient available() {
+		return WiFiClient();
+	}
+};
+
+class WiFiClass {
+public:
+	uint8_t status() {
+		return WL_IDLE_STATUS;
+	}
+	int begin(const char* ssid, const char* password) {
+		return WL_CONNECT_FAILED;
+	}
+	uint8_t* macAddress(uint8_t* mac) {
+		memset(mac, 0, 6);
+		return mac;
+	}
+	String firmwareVersion() {
+		return WIFI_FIRMWARE_LATEST_VERSION;
+	}
+	int8_t scanNetworks() {
+		return 0;
+	}
+	const char* SSID() {
+		return "";
+	}
+	const char* SSID(uint8_t network) {
+		return "";
+	}
+	int32_t RSSI() {
+		return 0;
+	}
+	int32_t RSSI(uint8_t network) {
+		return 0;
+	}
+	uint8_t channel(uint8_t network) {
+		return 0;
+	}
+	uint8_t encryptionType(uint8_t network) {
+		return ENC_TYPE_UNKNOWN;
+	}
+	IPAddress localIP() {
+		return IPAddress();
+	}
+};
+
+extern WiFiClass WiFi;
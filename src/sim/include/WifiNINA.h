@@ -0,0 +1,5 @@
+// Some sources include WiFiNINA.h as WifiNINA.h, which only works on
+// case-insensitive file systems
+#pragma once
+
+#include "WiFiNINA.h"
@@ -0,0 +1,170 @@
+// Runs the interface board sketch on a pseudo-terminal, against the simulated
+// typewriter
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+// Usage: wwpty [-s speed] [-l link] [-p page.txt] [-m model] [-w wheel]
+//   -s  Virtual time runs this many times faster than real time (default 1)
+//   -l  Symlink to the pty, e.g. /tmp/wheelwriter
+//   -p  Write the typed page to a file on exit
+//   -m  Model reported by the typewriter (default 0x06)
+//   -w  Printwheel reported by the typewriter (default 0x20)
+//
+// wheelwriter_interface.ino is compiled as is, with WiFi and flash stubbed out
+// and the USB serial port on the pty, so the clients in src/client can be
+// pointed at it (e.g. sendText.py /dev/pts/N). The clock is paced to real time
+// since the client runs in real time, so the timeouts and XON/XOFF flow
+// control behave as they do on the board. Ctrl-C prints the typewriter's
+// statistics.
+//
+#include <Arduino.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+#include <string>
+#include "MotorController.h"
+#include "SimBus.h"
+
+// Prototypes for the sketch's functions, which the Arduino builder would
+// generate
+void keyboardFunction(uint8_t verbose);
+void loopbackTest();
+void queryFunction();
+void rawCommandFunction();
+void readFunction();
+void sniffFunction();
+void relayFunction();
+void configCommand(unsigned char commandByte, unsigned long commandStartTime, unsigned long timeout);
+void relayCommand(char commandByte, unsigned long commandStartTime, unsigned long timeout);
+int timeoutCheckAndRespond(unsigned long commandStartTime, unsigned long timeout, unsigned char commandByte);
+void sendTimeoutResponse(unsigned char commandByte);
+void typeFunction(uint8_t keyboard, uint8_t useCaratAsControl, uint8_t bidirectional, uint8_t ordered, uint8_t overwrite, uint8_t impression);
+int connectWifi(char* ssid, char* password);
+int connectWifiSsid(const char* ssid, char* password);
+
+#include "wheelwriter_interface.ino"
+
+static sim::MotorController controller;
+static const char* pagePath = NULL;
+static const char* linkPath = NULL;
+static volatile sig_atomic_t stopRequested = 0;
+
+static void usage(const char* name) {
+	fprintf(stderr, "Usage: %s [-s speed] [-l link] [-p page.txt] [-m model] [-w wheel]\n", name);
+	exit(1);
+}
+
+static void onSignal(int signal) {
+	stopRequested = 1;
+}
+// The sketch polls Serial in all of its loops, so that's where we stop
+static void pollHook() {
+	if (stopRequested) {
+		exit(0);
+	}
+}
+
+static void report() {
+	const sim::MotorStats& stats = controller.stats();
+	sim::Bus& bus = sim::Bus::shared();
+	fprintf(stderr, "\nVirtual time:    %.3f s\n", sim::now() / 1e6);
+	fprintf(stderr, "Strikes:         %llu\n", (unsigned long long)stats.strikes);
+	fprintf(stderr, "Bus words:       %llu sent, %llu received\n", (unsigned long long)bus.hostWords(),
+	        (unsigned long long)bus.deviceWords());
+	fprintf(stderr, "ACKs held back:  %llu (%.3f s)\n", (unsigned long long)stats.stalls, stats.stallTime / 1e6);
+	if (pagePath) {
+		FILE* page = fopen(pagePath, "w");
+		if (page) {
+			std::string rendered = controller.renderPage();
+			fwrite(rendered.data(), 1, rendered.size(), page);
+			fclose(page);
+		}
+		else {
+			fprintf(stderr, "Can't write %s\n", pagePath);
+		}
+	}
+	if (linkPath) {
+		unlink(linkPath);
+	}
+}
+
+// Opens a pty in raw mode and returns the master side
+static int openPty(std::string& slaveName) {
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if ((master < 0) || grantpt(master) || unlockpt(master)) {
+		return -1;
+	}
+	slaveName = ptsname(master);
+	// Held open so the master doesn't see a hangup between clients
+	int slave = open(slaveName.c_str(), O_RDWR | O_NOCTTY);
+	if (slave < 0) {
+		return -1;
+	}
+	struct termios settings;
+	tcgetattr(slave, &settings);
+	cfmakeraw(&settings);
+	tcsetattr(slave, TCSANOW, &settings);
+	fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+	return master;
+}
+
+int main(int argc, char** argv) {
+	double speed = 1;
+	int option;
+	while ((option = getopt(argc, argv, "s:l:p:m:w:h")) != -1) {
+		switch (option) {
+			case 's':
+				speed = atof(optarg);
+				break;
+			case 'l':
+				linkPath = optarg;
+				break;
+			case 'p':
+				pagePath = optarg;
+				break;
+			case 'm':
+				controller.setModel(strtol(optarg, NULL, 0));
+				break;
+			case 'w':
+				controller.setWheel(strtol(optarg, NULL, 0));
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (speed <= 0) {
+		usage(argv[0]);
+	}
+
+	std::string slaveName;
+	int master = openPty(slaveName);
+	if (master < 0) {
+		perror("Can't open a pty");
+		return 1;
+	}
+	if (linkPath) {
+		unlink(linkPath);
+		if (symlink(slaveName.c_str(), linkPath)) {
+			perror("Can't create the link");
+			return 1;
+		}
+	}
+	fprintf(stderr, "Wheelwriter interface on %s\n", linkPath ? linkPath : slaveName.c_str());
+
+	sim::Bus::shared().attach(&controller);
+	Serial.setInput(master);
+	Serial.setOutput(master);
+	Serial.setPollHook(pollHook);
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+	atexit(report);
+
+	sim::setPace(speed);
+	setup();
+	while (true) {
+		loop();
+	}
+	return 0;
+}
@@ -0,0 +1,264 @@
+// Types a text file on a simulated Wheelwriter and reports the throughput
+//
+// Copyright (c) 2024 John Kua <john@kua.fm>
+//
+// Usage: wwsim [-a] [-b] [-o] [-g] [-i] [-w] [-l] [-m] [-c] [-u text] [-r repeat] [-p page.txt] [file]
+//   -a  Queue commands on the transaction engine (async mode)
+//   -b  Bidirectional printing
+//   -o  Order strikes within each line to cut wheel and carriage travel
+//   -g  Strike bold and underlines glyph by glyph, not in passes over the line
+//   -i  Strike each glyph at the impression in the printwheel's impression table
+//   -w  Overwrite mode - typing over a character erases it first
+//   -l  Lay plain text out on a page buffer a page at a time, then type it
+//   -m  Echo-masked UART
+//   -c  Run the bus through a BusCore, as the sketch's second core does
+//   -u  Type the file as a bulk print job, and send text as an urgent job once
+//       the first line is queued, so that it preempts the file at a line end
+//   -r  Type the file this many times
+//   -p  Write the typed page to a file
+//
+// Text goes through the same TypeStream the sketch uses, so escape
+// sequences work as they would over USB. Serial output goes to stderr.
+//
+#include <Arduino.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include "PageBuffer.h"
+#include "PrintJobQueue.h"
+#include "Wheelwriter.h"
+#include "MotorController.h"
+#include "SimBus.h"
+
+static const char* commandNames[16] = {
+	"query model", "reset", "type no advance", "type", "erase", "move platen", "move carriage", "spin wheel",
+	"query wheel", "repeat mode", "0x0a", "query status", "0x0c", "0x0d", "send code", "0x0f"
+};
+
+static void usage(const char* name) {
+	fprintf(stderr, "Usage: %s [-a] [-b] [-o] [-g] [-i] [-w] [-l] [-m] [-c] [-u text] [-r repeat] [-p page.txt] [file]\n", 
+	        name);
+	exit(1);
+}
+
+// Places each line of the text on a page buffer, and types the page when the
+// next line would go off the end of it. Control characters are dropped.
+static void typeLaidOut(wheelwriter::Wheelwriter& typewriter, const std::string& text) {
+	wheelwriter::PageBuffer page(typewriter);
+	int16_t x = 0;
+	int16_t y = 0;
+	for (char c : text) {
+		if (c == '\n') {
+			x = 0;
+			y += typewriter.lineSpace();
+			if (y + typewriter.lineSpace() > page.length()) {
+				page.render();
+				page.clear();
+				while (typewriter.verticalMicrospaces() < y) {
+					typewriter.lineFeed();
+				}
+				typewriter.setTopOfPage();
+				y = 0;
+			}
+		}
+		else if ((uint8_t)c >= ' ') {
+			if (c != ' ') {
+				page.placeAscii(x, y, c);
+			}
+			x += typewriter.charSpace();
+		}
+	}
+	page.render();
+	while (typewriter.verticalMicrospaces() < y) {
+		typewriter.lineFeed();
+	}
+}
+
+// Types the text as a bulk print job, with an urgent one cutting in after the
+// first line, as two REST clients would
+static void typePreempted(wheelwriter::Wheelwriter& typewriter, const std::string& text, const std::string& urgent) {
+	wheelwriter::PrintJobQueue jobs(typewriter);
+	uint16_t bulk = jobs.submitText(text, wheelwriter::JOB_PRIORITY_BULK);
+	bool submitted = false;
+	while (jobs.active()) {
+		jobs.service();
+		typewriter.service();
+		if (!submitted && (jobs.find(bulk)->lines > 0)) {
+			jobs.submitText(urgent, wheelwriter::JOB_PRIORITY_URGENT);
+			submitted = true;
+		}
+	}
+}
+
+static bool readFile(const char* path, std::string& text) {
+	FILE* file = path ? fopen(path, "rb") : stdin;
+	if (!file) {
+		return false;
+	}
+	char buffer[4096];
+	size_t count;
+	while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		text.append(buffer, count);
+	}
+	if (path) {
+		fclose(file);
+	}
+	return true;
+}
+
+int main(int argc, char** argv) {
+	bool async = false;
+	bool bidirectional = false;
+	bool ordered = false;
+	bool emphasisPasses = true;
+	bool impressionControl = false;
+	bool overwrite = false;
+	bool laidOut = false;
+	bool masked = false;
+	bool busCore = false;
+	const char* urgent = NULL;
+	unsigned repeat = 1;
+	const char* pagePath = NULL;
+	int option;
+	while ((option = getopt(argc, argv, "abogiwlmcu:r:p:h")) != -1) {
+		switch (option) {
+			case 'a':
+				async = true;
+				break;
+			case 'b':
+				bidirectional = true;
+				break;
+			case 'o':
+				ordered = true;
+				break;
+			case 'g':
+				emphasisPasses = false;
+				break;
+			case 'i':
+				impressionControl = true;
+				break;
+			case 'w':
+				overwrite = true;
+				break;
+			case 'l':
+				laidOut = true;
+				break;
+			case 'm':
+				masked = true;
+				break;
+			case 'c':
+				busCore = true;
+				break;
+			case 'u':
+				urgent = optarg;
+				break;
+			case 'r':
+				repeat = atoi(optarg);
+				break;
+			case 'p':
+				pagePath = optarg;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	const char* inputPath = (optind < argc) ? argv[optind] : NULL;
+
+	std::string text;
+	if (!readFile(inputPath, text)) {
+		fprintf(stderr, "Can't read %s\n", inputPath);
+		return 1;
+	}
+	Serial.setOutput(2);
+
+	sim::Bus bus;
+	sim::MotorController controller;
+	bus.attach(&controller);
+	Uart9Bit uart;
+	uart.init(&bus);
+	uart.setEchoMasked(masked);
+
+	wheelwriter::Wheelwriter typewriter;
+	typewriter.init(&uart);
+	// The sketch's second core, run inline
+	wheelwriter::BusCore core;
+	if (busCore) {
+		core.setInline(true);
+		typewriter.setBusCore(&core);
+	}
+
+	std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+	typewriter.queryModel();
+	typewriter.setSpaceForWheel();
+	typewriter.setLeftMargin();
+
+	uint64_t start = sim::now();
+	uint64_t chars = 0;
+	typewriter.typeStream.reset();
+	typewriter.setAsync(async);
+	typewriter.setBidirectional(bidirectional);
+	typewriter.setStrikeOrdering(ordered);
+	typewriter.setEmphasisPasses(emphasisPasses);
+	typewriter.setImpressionControl(impressionControl);
+	typewriter.setOverwrite(overwrite);
+	for (unsigned i = 0; i < repeat; i++) {
+		if (urgent) {
+			typePreempted(typewriter, text, urgent);
+			chars += text.size();
+			continue;
+		}
+		if (laidOut) {
+			typeLaidOut(typewriter, text);
+			chars += text.size();
+			continue;
+		}
+		for (char c : text) {
+			typewriter.typeStream << c;
+			chars++;
+			if (async) {
+				typewriter.service();
+			}
+		}
+	}
+	typewriter.setAsync(false);
+	typewriter.flush();
+	// Count the time until the mechanism stops, not just the last ACK
+	sim::advanceTo(controller.idleTime());
+	uint64_t elapsed = sim::now() - start;
+	double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+	const sim::MotorStats& stats = controller.stats();
+	printf("Characters:      %llu\n", (unsigned long long)chars);
+	printf("Strikes:         %llu\n", (unsigned long long)stats.strikes);
+	if (stats.heavyStrikes) {
+		printf("  heavy          %llu\n", (unsigned long long)stats.heavyStrikes);
+	}
+	printf("Bus words:       %llu sent, %llu received\n", (unsigned long long)bus.hostWords(),
+	       (unsigned long long)bus.deviceWords());
+	for (int i = 0; i < 16; i++) {
+		if (stats.commands[i]) {
+			printf("  %-16s %llu\n", commandNames[i], (unsigned long long)stats.commands[i]);
+		}
+	}
+	printf("Carriage travel: %llu microspaces\n", (unsigned long long)stats.carriageTravel);
+	printf("Platen travel:   %llu microspaces\n", (unsigned long long)stats.platenTravel);
+	printf("Wheel travel:    %llu petals\n", (unsigned long long)stats.wheelTravel);
+	printf("ACKs held back:  %llu (%.3f s)\n", (unsigned long long)stats.stalls, stats.stallTime / 1e6);
+	printf("Virtual time:    %.3f s\n", elapsed / 1e6);
+	printf("Throughput:      %.2f chars/s\n", elapsed ? chars * 1e6 / elapsed : 0.0);
+	printf("Wall time:       %.3f s\n", wall);
+
+	if (pagePath) {
+		FILE* page = fopen(pagePath, "w");
+		if (!page) {
+			fprintf(stderr, "Can't write %s\n", pagePath);
+			return 1;
+		}
+		std::string rendered = controller.renderPage();
+		fwrite(rendered.data(), 1, rendered.size(), page);
+		fclose(page);
+	}
+	return 0;
+}